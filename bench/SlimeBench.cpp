@@ -0,0 +1,670 @@
+#ifndef SLIME_BENCH_CPU_ONLY
+#include <GLAD/glad.h>
+#include <SDL2/SDL.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AgentKernel.hpp"
+#include "AgentSpawner.hpp"
+#include "CpuSimulation.hpp"
+#include "ThreadPool.hpp"
+
+#ifndef SLIME_BENCH_CPU_ONLY
+#include "GpuBackend.hpp"
+#include "Profiler.hpp"
+#endif
+
+/*
+Runs the simulation over a fixed set of scenarios, every agent count with every trail
+map size and spawn mode, and writes how long each stage took per agent or per pixel as
+JSON. Everything is seeded, so runs on different commits simulate the same thing and
+their results can be compared directly.
+
+    slime_bench --output before.json
+    slime_bench --agents 1000000 --trail-sizes 1920x1080 --spawn random --steps 50
+
+With --verify-kernels it instead checks the vectorised agent kernels against the scalar
+loop on each scenario, and exits with 1 when any agent is outside their tolerance.
+*/
+
+const uint32_t BENCH_SEED = 1234;
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
+
+struct scenario
+{
+    size_t agents;
+    unsigned int width, height;
+    generationType spawn;
+};
+
+// Nanoseconds per agent or per pixel for each timed step
+struct stageSamples
+{
+    std::string name;
+    std::string unit;
+    std::vector<double> samples;
+};
+
+struct scenarioResult
+{
+    std::string backend;
+    scenario config;
+    std::vector<stageSamples> stages;
+    // Hash of the CPU state after the last step, which only changes when the simulation does
+    std::string checksum;
+};
+
+struct benchOptions
+{
+    std::vector<size_t> agents = { 100000, 1000000, 10000000 };
+    std::vector<glm::uvec2> trailSizes = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+    std::vector<generationType> spawns = { generationType::IN_CIRCLE, generationType::OUT_CIRCLE, generationType::RANDOM };
+
+    bool cpu = true;
+    bool gpu = true;
+    bool verifyKernels = false;
+    int warmupSteps = 3;
+    int steps = 10;
+    int sortInterval = 4;
+    unsigned int threads = 0;
+    agentKernelType kernel = agentKernelType::AUTO;
+    std::string output;
+    std::string label;
+};
+
+const char* getSpawnName(generationType type)
+{
+    switch (type)
+    {
+        case generationType::IN_CIRCLE: return "in";
+        case generationType::OUT_CIRCLE: return "out";
+        case generationType::RANDOM: return "random";
+    }
+    return "";
+}
+
+bool parseList(const char* value, std::vector<std::string>& items)
+{
+    items.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (item.empty())
+            return false;
+        items.push_back(item);
+    }
+    return !items.empty();
+}
+
+bool parseArguments(int argc, char* argv[], benchOptions& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+
+        if (strcmp(argument, "--cpu") == 0) { opts.gpu = false; continue; }
+        if (strcmp(argument, "--gpu") == 0) { opts.cpu = false; continue; }
+        if (strcmp(argument, "--verify-kernels") == 0) { opts.verifyKernels = true; continue; }
+        if (strcmp(argument, "--quick") == 0)
+        {
+            opts.agents = { 100000 };
+            opts.trailSizes = { { 1280, 720 } };
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Unknown argument or missing value: " << argument << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        std::vector<std::string> items;
+
+        if (strcmp(argument, "--steps") == 0) opts.steps = std::max(1, atoi(value));
+        else if (strcmp(argument, "--warmup") == 0) opts.warmupSteps = std::max(0, atoi(value));
+        else if (strcmp(argument, "--sort-interval") == 0) opts.sortInterval = std::max(0, atoi(value));
+        else if (strcmp(argument, "--threads") == 0) opts.threads = atoi(value);
+        else if (strcmp(argument, "--output") == 0) opts.output = value;
+        else if (strcmp(argument, "--label") == 0) opts.label = value;
+        else if (strcmp(argument, "--agents") == 0)
+        {
+            if (!parseList(value, items))
+            {
+                std::cerr << "Expected --agents COUNT[,COUNT...]" << std::endl;
+                return false;
+            }
+            opts.agents.clear();
+            for (const std::string& item : items)
+                opts.agents.push_back(strtoull(item.c_str(), NULL, 10));
+        }
+        else if (strcmp(argument, "--trail-sizes") == 0)
+        {
+            bool valid = parseList(value, items);
+            opts.trailSizes.clear();
+            for (const std::string& item : items)
+            {
+                glm::uvec2 size;
+                if (sscanf(item.c_str(), "%ux%u", &size.x, &size.y) != 2 || size.x == 0 || size.y == 0)
+                    valid = false;
+                opts.trailSizes.push_back(size);
+            }
+            if (!valid)
+            {
+                std::cerr << "Expected --trail-sizes WIDTHxHEIGHT[,WIDTHxHEIGHT...]" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--spawn") == 0)
+        {
+            bool valid = parseList(value, items);
+            opts.spawns.clear();
+            for (const std::string& item : items)
+            {
+                if (item == "in") opts.spawns.push_back(generationType::IN_CIRCLE);
+                else if (item == "out") opts.spawns.push_back(generationType::OUT_CIRCLE);
+                else if (item == "random") opts.spawns.push_back(generationType::RANDOM);
+                else valid = false;
+            }
+            if (!valid)
+            {
+                std::cerr << "Expected --spawn in|out|random[,...]" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--agent-kernel") == 0)
+        {
+            if (strcmp(value, "auto") == 0) opts.kernel = agentKernelType::AUTO;
+            else if (strcmp(value, "scalar") == 0) opts.kernel = agentKernelType::SCALAR;
+            else if (strcmp(value, "avx2") == 0) opts.kernel = agentKernelType::AVX2;
+            else if (strcmp(value, "avx512") == 0) opts.kernel = agentKernelType::AVX512;
+            else
+            {
+                std::cerr << "Expected --agent-kernel auto|scalar|avx2|avx512" << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << argument << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The interactive defaults, apart from the seed and sorting
+SimulationSettings getSettings(const benchOptions& opts)
+{
+    SimulationSettings settings;
+    settings.decayAmount = 0.3f;
+    settings.diffuseSpeed = 0.3f;
+    settings.diffuseRadius = 1;
+    settings.movementDistance = 10.0f;
+    settings.sensorDistance = 4.0f;
+    settings.sensorAngle = 45.0f;
+    settings.rotationAngle = 45.0f;
+    settings.deposit = depositMode::OVERWRITE;
+    settings.depositAmount = 1.0f;
+    settings.seed = BENCH_SEED;
+    settings.sortInterval = opts.sortInterval;
+    return settings;
+}
+
+SpawnSettings getSpawnSettings(const scenario& config)
+{
+    SpawnSettings settings;
+    settings.type = config.spawn;
+    settings.radius = (float)(config.height / 2);
+    settings.width = config.width;
+    settings.height = config.height;
+    settings.seed = BENCH_SEED;
+    return settings;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+scenarioResult runCpu(const benchOptions& opts, ThreadPool& pool, const scenario& config)
+{
+    const SimulationSettings settings = getSettings(opts);
+    const double agents = (double)config.agents;
+    const double pixels = (double)config.width * config.height;
+
+    CpuSimulation simulation(pool, config.width, config.height);
+    simulation.setAgentKernel(opts.kernel);
+    simulation.spawnAgents(getSpawnSettings(config), config.agents);
+    simulation.clearTrail();
+
+    for (int i = 0; i < opts.warmupSteps; i++)
+        simulation.step(settings, BENCH_TIMESTEP);
+
+    scenarioResult result;
+    result.backend = "CPU";
+    result.config = config;
+    result.stages = {
+        { "step", "agent", {} },
+        { "step", "pixel", {} },
+        { "agents", "agent", {} },
+        { "deposit", "agent", {} },
+        { "diffuse", "pixel", {} },
+        { "sort", "agent", {} }
+    };
+
+    for (int i = 0; i < opts.steps; i++)
+    {
+        bool sorts = settings.sortInterval > 0 && simulation.getStepCount() % settings.sortInterval == 0;
+
+        auto start = std::chrono::steady_clock::now();
+        simulation.step(settings, BENCH_TIMESTEP);
+        double seconds = secondsSince(start);
+
+        result.stages[0].samples.push_back(seconds * 1e9 / agents);
+        result.stages[1].samples.push_back(seconds * 1e9 / pixels);
+        result.stages[2].samples.push_back(simulation.getAgentPassSeconds() * 1e9 / agents);
+        result.stages[3].samples.push_back(simulation.getDepositPassSeconds() * 1e9 / agents);
+        result.stages[4].samples.push_back(simulation.getDiffusePassSeconds() * 1e9 / pixels);
+        if (sorts)
+            result.stages[5].samples.push_back(simulation.getSortSeconds() * 1e9 / agents);
+    }
+
+    char checksum[17];
+    snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)simulation.getChecksum());
+    result.checksum = checksum;
+    return result;
+}
+
+// Difference allowed from the scalar loop in a value of this size, see AgentKernel.hpp
+float getKernelTolerance(float tolerance, float value)
+{
+    return std::max(tolerance, 2.0f * FLT_EPSILON * std::abs(value));
+}
+
+// Whether an agent's sensors sample within the kernel tolerance of a pixel edge, where
+// the kernels' sin/cos can read the neighbouring pixel, see AgentKernel.hpp
+bool isSensorNearEdge(const SimulationSettings& settings, glm::vec2 pos, float angle)
+{
+    const float offsets[] = { 0.0f, -settings.sensorAngle, settings.sensorAngle };
+    for (float offset : offsets)
+    {
+        float radians = glm::radians(angle + offset);
+        glm::vec2 sample = pos + settings.sensorDistance * glm::vec2(std::cos(radians), std::sin(radians));
+        glm::vec2 edge = glm::abs(sample - glm::round(sample));
+        if (edge.x <= AGENT_KERNEL_POSITION_TOLERANCE || edge.y <= AGENT_KERNEL_POSITION_TOLERANCE)
+            return true;
+    }
+    return false;
+}
+
+// Runs the warmup with the scalar loop, so every kernel starts from the same agents and
+// trail map, then steps once with the given kernel
+std::unique_ptr<CpuSimulation> stepWithKernel(const benchOptions& opts, ThreadPool& pool, const scenario& config, agentKernelType kernel, AgentStore* start)
+{
+    const SimulationSettings settings = getSettings(opts);
+
+    std::unique_ptr<CpuSimulation> simulation(new CpuSimulation(pool, config.width, config.height));
+    simulation->setAgentKernel(agentKernelType::SCALAR);
+    simulation->spawnAgents(getSpawnSettings(config), config.agents);
+    simulation->clearTrail();
+    for (int i = 0; i < opts.warmupSteps; i++)
+        simulation->step(settings, BENCH_TIMESTEP);
+
+    if (start)
+        *start = simulation->getAgents();
+
+    // Not sorted, so agents stay at the same index as in start
+    SimulationSettings unsorted = settings;
+    unsorted.sortInterval = 0;
+    simulation->setAgentKernel(kernel);
+    simulation->step(unsorted, BENCH_TIMESTEP);
+    return simulation;
+}
+
+// Compares one step of each vectorised kernel this CPU has with the scalar loop
+bool verifyKernels(const benchOptions& opts, ThreadPool& pool, const scenario& config)
+{
+    const SimulationSettings settings = getSettings(opts);
+
+    AgentStore start;
+    std::unique_ptr<CpuSimulation> scalar = stepWithKernel(opts, pool, config, agentKernelType::SCALAR, &start);
+    const AgentStore& expected = scalar->getAgents();
+
+    bool passed = true;
+    for (agentKernelType kernel : { agentKernelType::AVX2, agentKernelType::AVX512 })
+    {
+        std::cerr << getAgentKernelName(kernel) << " " << config.agents << " agents " << config.width << "x" << config.height
+            << " " << getSpawnName(config.spawn) << ": ";
+        if (!getAgentKernel(kernel))
+        {
+            std::cerr << "not available, skipped" << std::endl;
+            continue;
+        }
+
+        std::unique_ptr<CpuSimulation> simulation = stepWithKernel(opts, pool, config, kernel, nullptr);
+        const AgentStore& agents = simulation->getAgents();
+
+        size_t failures = 0, nearEdge = 0;
+        float positionError = 0.0f, angleError = 0.0f;
+        for (size_t i = 0; i < agents.size(); i++)
+        {
+            glm::vec2 pos = expected.getPosition(i);
+            glm::vec2 offset = glm::abs(agents.getPosition(i) - pos);
+            float position = std::max(offset.x, offset.y);
+            float angle = std::abs(agents.angle[i] - expected.angle[i]);
+
+            bool positionMatches = offset.x <= getKernelTolerance(AGENT_KERNEL_POSITION_TOLERANCE, pos.x)
+                && offset.y <= getKernelTolerance(AGENT_KERNEL_POSITION_TOLERANCE, pos.y);
+            bool angleMatches = angle <= getKernelTolerance(AGENT_KERNEL_ANGLE_TOLERANCE, expected.angle[i]);
+
+            if (positionMatches && !angleMatches && isSensorNearEdge(settings, start.getPosition(i), start.angle[i]))
+            {
+                nearEdge++;
+                continue;
+            }
+
+            positionError = std::max(positionError, position);
+            angleError = std::max(angleError, angle);
+            if (!positionMatches || !angleMatches)
+                failures++;
+        }
+
+        std::cerr << (failures == 0 ? "passed" : "FAILED") << ", " << failures << " agents outside the tolerance, "
+            << nearEdge << " turned differently at a pixel edge, max error " << positionError << " px "
+            << angleError << " degrees" << std::endl;
+        passed = passed && failures == 0;
+    }
+    return passed;
+}
+
+#ifndef SLIME_BENCH_CPU_ONLY
+// The GPU backend's profiler passes and the stages they are reported as
+struct gpuStage
+{
+    const char* pass;
+    const char* name;
+    bool perPixel;
+};
+
+const gpuStage GPU_STAGES[] = {
+    { "Agents", "agents", false },
+    { "Diffuse Blur", "diffuseBlur", true },
+    { "Diffuse Decay", "diffuseDecay", true },
+    { "Sort", "sort", false }
+};
+
+// Whole steps are timed from the host, and each pass with GPU timer queries
+scenarioResult runGpu(const benchOptions& opts, ThreadPool& pool, GpuBackend& backend, const scenario& config)
+{
+    const SimulationSettings settings = getSettings(opts);
+    const double agents = (double)config.agents;
+    const double pixels = (double)config.width * config.height;
+
+    backend.resize(config.width, config.height);
+    backend.spawn(pool, getSpawnSettings(config), config.agents);
+    backend.prepareShaders(settings);
+
+    for (int i = 0; i < opts.warmupSteps; i++)
+        backend.step(settings, BENCH_TIMESTEP);
+    backend.finish();
+
+    scenarioResult result;
+    result.backend = "GPU";
+    result.config = config;
+    result.stages = {
+        { "step", "agent", {} },
+        { "step", "pixel", {} }
+    };
+
+    Profiler profiler;
+    backend.setProfiler(&profiler);
+
+    for (int i = 0; i < opts.steps; i++)
+    {
+        profiler.beginFrame();
+
+        auto start = std::chrono::steady_clock::now();
+        backend.step(settings, BENCH_TIMESTEP);
+        backend.finish();
+        double seconds = secondsSince(start);
+
+        profiler.endFrame();
+
+        result.stages[0].samples.push_back(seconds * 1e9 / agents);
+        result.stages[1].samples.push_back(seconds * 1e9 / pixels);
+    }
+
+    profiler.flush();
+    backend.setProfiler(nullptr);
+
+    // Every timed step is one frame of the profiler's history, oldest first
+    for (const gpuStage& stage : GPU_STAGES)
+    {
+        stageSamples samples = { stage.name, stage.perPixel ? "pixel" : "agent", {} };
+        for (const Profiler::passHistory& pass : profiler.getPasses())
+        {
+            if (pass.name != stage.pass)
+                continue;
+
+            const int count = std::min(pass.count, opts.steps);
+            for (int i = pass.count - count; i < pass.count; i++)
+            {
+                int index = pass.count == Profiler::HISTORY ? (pass.next + i) % Profiler::HISTORY : i;
+                // Steps that did not sort show up as 0
+                if (pass.milliseconds[index] > 0.0f)
+                    samples.samples.push_back(pass.milliseconds[index] * 1e6 / (stage.perPixel ? pixels : agents));
+            }
+        }
+        result.stages.push_back(samples);
+    }
+
+    return result;
+}
+#endif
+
+std::string escapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            c = ' ';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeStage(std::ostream& out, const stageSamples& stage)
+{
+    const std::vector<double>& samples = stage.samples;
+    const size_t count = samples.size();
+
+    double mean = 0.0;
+    for (double sample : samples)
+        mean += sample;
+    mean /= count;
+
+    // Sample variance, so a handful of steps does not understate it
+    double variance = 0.0;
+    for (double sample : samples)
+        variance += (sample - mean) * (sample - mean);
+    variance = count > 1 ? variance / (count - 1) : 0.0;
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    double median = count % 2 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+
+    out << "{ \"stage\": \"" << stage.name << "\", \"unit\": \"ns/" << stage.unit << "\", \"samples\": " << count
+        << ", \"mean\": " << mean << ", \"median\": " << median << ", \"min\": " << sorted.front() << ", \"max\": " << sorted.back()
+        << ", \"stddev\": " << std::sqrt(variance) << ", \"variance\": " << variance << " }";
+}
+
+void writeJson(std::ostream& out, const benchOptions& opts, ThreadPool& pool, const std::string& gpuName, const std::vector<scenarioResult>& results)
+{
+    out.precision(6);
+    out << "{\n";
+    out << "  \"label\": \"" << escapeJson(opts.label) << "\",\n";
+    out << "  \"seed\": " << BENCH_SEED << ",\n";
+    out << "  \"timestep\": " << BENCH_TIMESTEP << ",\n";
+    out << "  \"warmupSteps\": " << opts.warmupSteps << ",\n";
+    out << "  \"steps\": " << opts.steps << ",\n";
+    out << "  \"sortInterval\": " << opts.sortInterval << ",\n";
+    out << "  \"cpuThreads\": " << pool.getThreadCount() << ",\n";
+    out << "  \"gpu\": \"" << escapeJson(gpuName) << "\",\n";
+    out << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const scenarioResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"backend\": \"" << result.backend << "\",\n";
+        out << "      \"agents\": " << result.config.agents << ",\n";
+        out << "      \"width\": " << result.config.width << ",\n";
+        out << "      \"height\": " << result.config.height << ",\n";
+        out << "      \"spawn\": \"" << getSpawnName(result.config.spawn) << "\",\n";
+        if (!result.checksum.empty())
+            out << "      \"checksum\": \"" << result.checksum << "\",\n";
+        out << "      \"stages\": [";
+
+        bool first = true;
+        for (const stageSamples& stage : result.stages)
+        {
+            // Sorting is skipped when no timed step sorted
+            if (stage.samples.empty())
+                continue;
+            out << (first ? "\n" : ",\n") << "        ";
+            writeStage(out, stage);
+            first = false;
+        }
+        out << "\n      ]\n";
+        out << "    }";
+    }
+
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+void printSummary(const scenarioResult& result)
+{
+    std::cerr << result.backend << " " << result.config.agents << " agents " << result.config.width << "x" << result.config.height
+        << " " << getSpawnName(result.config.spawn) << ":";
+    for (const stageSamples& stage : result.stages)
+    {
+        if (stage.samples.empty())
+            continue;
+        double mean = 0.0;
+        for (double sample : stage.samples)
+            mean += sample;
+        std::cerr << " " << stage.name << " " << mean / stage.samples.size() << " ns/" << stage.unit;
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    benchOptions opts;
+    if (!parseArguments(argc, argv, opts))
+        return 1;
+
+    ThreadPool pool(opts.threads);
+
+    std::vector<scenario> scenarios;
+    for (const glm::uvec2& size : opts.trailSizes)
+        for (size_t agents : opts.agents)
+            for (generationType spawn : opts.spawns)
+                scenarios.push_back({ agents, size.x, size.y, spawn });
+
+    if (opts.verifyKernels)
+    {
+        bool passed = true;
+        for (const scenario& config : scenarios)
+            passed = verifyKernels(opts, pool, config) && passed;
+        return passed ? 0 : 1;
+    }
+
+    std::vector<scenarioResult> results;
+
+    if (opts.cpu)
+    {
+        CpuSimulation probe(pool, 1, 1);
+        probe.setAgentKernel(opts.kernel);
+        std::cerr << "CPU backend on " << pool.getThreadCount() << " threads, " << getAgentKernelName(probe.getAgentKernel()) << " agent kernel" << std::endl;
+
+        for (const scenario& config : scenarios)
+        {
+            results.push_back(runCpu(opts, pool, config));
+            printSummary(results.back());
+        }
+    }
+
+    std::string gpuName;
+#ifndef SLIME_BENCH_CPU_ONLY
+    if (opts.gpu)
+    {
+        SDL_Init(SDL_INIT_VIDEO);
+
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+        SDL_Window* window = SDL_CreateWindow("slime_bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        SDL_GLContext context = window ? SDL_GL_CreateContext(window) : NULL;
+
+        if (context && gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress) && (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3)))
+        {
+            gpuName = (const char*)glGetString(GL_RENDERER);
+            std::cerr << "GPU backend on " << gpuName << std::endl;
+
+            std::unique_ptr<GpuBackend> backend(new GpuBackend(1, 1));
+            for (const scenario& config : scenarios)
+            {
+                results.push_back(runGpu(opts, pool, *backend, config));
+                printSummary(results.back());
+            }
+        }
+        else
+        {
+            std::cerr << "OpenGL 4.3 is not available, skipping the GPU backend" << std::endl;
+        }
+
+        if (context)
+            SDL_GL_DeleteContext(context);
+        if (window)
+            SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+#endif
+
+    if (opts.output.empty())
+    {
+        writeJson(std::cout, opts, pool, gpuName, results);
+        return 0;
+    }
+
+    std::ofstream file(opts.output);
+    if (!file)
+    {
+        std::cerr << "Unable to write " << opts.output << std::endl;
+        return 1;
+    }
+    writeJson(file, opts, pool, gpuName, results);
+    return 0;
+}
@@ -1,101 +1,107 @@
 #version 430
 
-struct agent
-{
-    vec3 pos;
-    float angle;
-};
+#include "random.glsl"
+#include "simulationParams.glsl"
+
+// Set by GpuBackend when the shader is compiled
+#ifndef AGENT_GROUP_SIZE
+#define AGENT_GROUP_SIZE 64
+#endif
 
-layout (local_size_x = 1, local_size_y = 1) in;
+layout (local_size_x = AGENT_GROUP_SIZE, local_size_y = 1) in;
 
-layout (binding = 0, rgba32f) uniform image2D texture;
+layout (binding = 0, r32f) uniform image2D texture;
+layout (binding = 3, r32ui) uniform uimage2D depositCounts;
 
-layout (std430, binding = 1) buffer bufferData
+layout (std430, binding = 1) buffer agentX
 {
-    agent agents[];
+    float xs[];
 };
 
-uniform int agentCount;
-uniform float movementDistance;
-uniform float deltaTime;
-uniform float sensorDistance;
-uniform float sensorAngle;
-uniform float rotationAngle;
-
-float random(vec2 st)
+layout (std430, binding = 2) buffer agentY
 {
-    return fract(sin(dot(st.xy, vec2(12.9898, 78.233))) * 43758.5453123);
-}
+    float ys[];
+};
 
-float strength(vec4 colour)
+layout (std430, binding = 3) buffer agentAngle
 {
-    return colour.r + colour.g + colour.b;
-}
+    float angles[];
+};
 
 void main()
 {
-    ivec2 px = ivec2(gl_GlobalInvocationID.xy);
-    ivec2 size = imageSize(texture);
+    // Large dispatches are split over rows of workgroups, and the last one may run past the end
+    uint index = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+    if (index >= uint(agentCount))
+        return;
 
-    agent a = agents[px.x];
+    ivec2 size = imageSize(texture);
 
-    vec2 pos = a.pos.xy;
+    vec2 pos = vec2(xs[index], ys[index]);
+    float angle = angles[index];
+    float newAngle = angle;
     vec2 newPos;
 
     // Movement Stage
-    newPos.x = pos.x + (movementDistance * cos(radians(a.angle)) * deltaTime);
-    newPos.y = pos.y + (movementDistance * sin(radians(a.angle)) * deltaTime);
+    newPos.x = pos.x + (movementDistance * cos(radians(angle)) * deltaTime);
+    newPos.y = pos.y + (movementDistance * sin(radians(angle)) * deltaTime);
 
-    float rnd = random(newPos);
+    uvec2 bits = philox(uvec2(index, stepIndex), seed ^ RANDOM_STREAM_AGENT);
+    float rnd = uniformFloat(bits.x);
 
     if (newPos.x >= size.x || newPos.x <= 0 || newPos.y >= size.y || newPos.y <= 0)
     {
         newPos = clamp(newPos, vec2(0.0), vec2(size - 1));
-        float newAngle = 180 + (rnd * 30.0 - 15.0);
-        agents[px.x].angle = newAngle;
+        newAngle = 180 + (rnd * 30.0 - 15.0);
     }
 
-    agents[px.x].pos = vec3(newPos, 0.0);
+    xs[index] = newPos.x;
+    ys[index] = newPos.y;
 
-    imageStore(texture, ivec2(pos), vec4(1.0));
+    if (ACCUMULATE_DEPOSITS)
+        imageAtomicAdd(depositCounts, ivec2(pos), 1u);
+    else
+        imageStore(texture, ivec2(pos), vec4(depositAmount));
 
     // Sensory Stage
     ivec2 positionI;
     vec2 position;
-    position.x = pos.x + (sensorDistance * cos(radians(a.angle)));
-    position.y = pos.y + (sensorDistance * sin(radians(a.angle)));
+    position.x = pos.x + (sensorDistance * cos(radians(angle)));
+    position.y = pos.y + (sensorDistance * sin(radians(angle)));
     positionI = ivec2(position.x, position.y);
-    float front = strength(imageLoad(texture, positionI));
+    float front = imageLoad(texture, positionI).r;
 
-    position.x = pos.x + (sensorDistance * cos(radians(a.angle - sensorAngle)));
-    position.y = pos.y + (sensorDistance * sin(radians(a.angle - sensorAngle)));
+    position.x = pos.x + (sensorDistance * cos(radians(angle - sensorAngle)));
+    position.y = pos.y + (sensorDistance * sin(radians(angle - sensorAngle)));
     positionI = ivec2(position.x, position.y);
-    float frontLeft = strength(imageLoad(texture, positionI));
+    float frontLeft = imageLoad(texture, positionI).r;
 
-    position.x = pos.x + (sensorDistance * cos(radians(a.angle + sensorAngle)));
-    position.y = pos.y + (sensorDistance * sin(radians(a.angle + sensorAngle)));
+    position.x = pos.x + (sensorDistance * cos(radians(angle + sensorAngle)));
+    position.y = pos.y + (sensorDistance * sin(radians(angle + sensorAngle)));
     positionI = ivec2(position.x, position.y);
-    float frontRight = strength(imageLoad(texture, positionI));
+    float frontRight = imageLoad(texture, positionI).r;
 
     if (front < frontLeft && front < frontRight) // Rotate Randomly
     {
-        float r = random(newPos);
+        float r = uniformFloat(bits.y);
         if (r < 0.5) // Rotate Left
-            agents[px.x].angle -= rotationAngle * rnd;
+            newAngle -= rotationAngle * rnd;
         else // Rotate Right
-            agents[px.x].angle += rotationAngle * rnd;
+            newAngle += rotationAngle * rnd;
     }
     else if (frontLeft > frontRight) // Rotate Left
     {
-        agents[px.x].angle -= rotationAngle * rnd;
+        newAngle -= rotationAngle * rnd;
     }
     else if (frontRight > frontLeft) // Rotate Right
     {
-        agents[px.x].angle += rotationAngle * rnd;
+        newAngle += rotationAngle * rnd;
     }
     else // Stay Forwards
     {
 
     }
+
+    angles[index] = newAngle;
 }
 
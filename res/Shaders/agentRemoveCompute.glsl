@@ -0,0 +1,43 @@
+#version 430
+
+// Moves the agents that survive a removal past the new agent count into the gaps
+// left below it, see getAgentRemovalMoves. No agent is both moved to and from.
+
+#define REMOVE_GROUP_SIZE 64
+
+layout (local_size_x = REMOVE_GROUP_SIZE, local_size_y = 1) in;
+
+layout (std430, binding = 1) buffer agentX
+{
+    float xs[];
+};
+
+layout (std430, binding = 2) buffer agentY
+{
+    float ys[];
+};
+
+layout (std430, binding = 3) buffer agentAngle
+{
+    float angles[];
+};
+
+// (to, from) agent indices
+layout (std430, binding = 4) buffer removalMoves
+{
+    uvec2 moves[];
+};
+
+uniform int moveCount;
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+    if (index >= uint(moveCount))
+        return;
+
+    uvec2 move = moves[index];
+    xs[move.x] = xs[move.y];
+    ys[move.x] = ys[move.y];
+    angles[move.x] = angles[move.y];
+}
@@ -0,0 +1,141 @@
+#version 430
+
+// First and last pass of one digit of GpuBackend's radix sort of the agents by trail
+// tile. Each workgroup takes a fixed chunk of agents. Compiled once to count the agents
+// of each digit in the chunk, and once with SCATTER defined to move them to where the
+// chunk's agents of that digit start, once the counts have been scanned into offsets.
+
+#define SORT_GROUP_SIZE 256
+// Must match GpuBackend.hpp
+#define SORT_CHUNK 4096
+// One invocation per digit when counting and offsetting, so equal to SORT_GROUP_SIZE
+#define RADIX_SIZE 256
+// Must match SimulationBackend.hpp
+#define AGENT_SORT_TILE 16
+
+layout (local_size_x = SORT_GROUP_SIZE, local_size_y = 1) in;
+
+layout (std430, binding = 1) buffer agentX
+{
+    float xs[];
+};
+
+layout (std430, binding = 2) buffer agentY
+{
+    float ys[];
+};
+
+// Agents of each digit in each chunk, digit major, or where they go when scattering
+layout (std430, binding = 4) buffer digitOffsets
+{
+    uint offsets[];
+};
+
+#ifdef SCATTER
+layout (std430, binding = 3) buffer agentAngle
+{
+    float angles[];
+};
+
+layout (std430, binding = 5) buffer sortedX
+{
+    float sortedXs[];
+};
+
+layout (std430, binding = 6) buffer sortedY
+{
+    float sortedYs[];
+};
+
+layout (std430, binding = 7) buffer sortedAngle
+{
+    float sortedAngles[];
+};
+#endif
+
+uniform int agentCount;
+uniform uint tilesX;
+uniform uint tilesY;
+uniform uint shift;
+uniform uint chunkCount;
+
+shared uint counts[RADIX_SIZE];
+#ifdef SCATTER
+shared uint digits[SORT_GROUP_SIZE];
+#endif
+
+uint spread(uint v)
+{
+    v &= 0xFFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+// Same key as CpuSimulation::sortAgents
+uint getDigit(uint index)
+{
+    vec2 pos = vec2(xs[index], ys[index]);
+    uvec2 tile = min(uvec2(max(pos, vec2(0.0))) / uint(AGENT_SORT_TILE), uvec2(tilesX, tilesY) - 1u);
+    uint key = spread(tile.x) | (spread(tile.y) << 1);
+    return (key >> shift) & uint(RADIX_SIZE - 1);
+}
+
+void main()
+{
+    uint lane = gl_LocalInvocationID.x;
+    uint chunk = gl_WorkGroupID.x;
+    uint chunkBegin = chunk * uint(SORT_CHUNK);
+    uint chunkEnd = min(chunkBegin + uint(SORT_CHUNK), uint(agentCount));
+
+#ifdef SCATTER
+    // Where the chunk's next agent of each digit goes
+    counts[lane] = offsets[lane * chunkCount + chunk];
+    barrier();
+
+    // Agents are taken a round of SORT_GROUP_SIZE at a time, in order, and each goes
+    // after the agents of the same digit earlier in the chunk, so the sort is stable
+    for (uint first = chunkBegin; first < chunkEnd; first += uint(SORT_GROUP_SIZE))
+    {
+        uint index = first + lane;
+        bool valid = index < chunkEnd;
+        uint digit = valid ? getDigit(index) : uint(RADIX_SIZE);
+        digits[lane] = digit;
+        barrier();
+
+        // Reads of digits[j] are the same for every invocation, so they broadcast
+        uint rank = 0u;
+        uint laneDigitCount = 0u;
+        for (uint j = 0u; j < uint(SORT_GROUP_SIZE); j++)
+        {
+            uint other = digits[j];
+            rank += (j < lane && other == digit) ? 1u : 0u;
+            laneDigitCount += other == lane ? 1u : 0u;
+        }
+
+        if (valid)
+        {
+            uint slot = counts[digit] + rank;
+            sortedXs[slot] = xs[index];
+            sortedYs[slot] = ys[index];
+            sortedAngles[slot] = angles[index];
+        }
+        barrier();
+
+        counts[lane] += laneDigitCount;
+        barrier();
+    }
+#else
+    counts[lane] = 0u;
+    barrier();
+
+    // Only the totals are kept, so the order the atomics land in does not matter
+    for (uint index = chunkBegin + lane; index < chunkEnd; index += uint(SORT_GROUP_SIZE))
+        atomicAdd(counts[getDigit(index)], 1u);
+    barrier();
+
+    offsets[lane * chunkCount + chunk] = counts[lane];
+#endif
+}
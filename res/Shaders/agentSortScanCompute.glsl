@@ -0,0 +1,52 @@
+#version 430
+
+// Middle pass of each digit of GpuBackend's agent sort. A single workgroup turns the
+// agent count of every digit of every chunk, digit major, into where the first of
+// those agents goes in the sorted buffers.
+
+#define SCAN_GROUP_SIZE 1024
+
+layout (local_size_x = SCAN_GROUP_SIZE, local_size_y = 1) in;
+
+layout (std430, binding = 4) buffer digitOffsets
+{
+    uint offsets[];
+};
+
+uniform uint offsetCount;
+
+shared uint partial[SCAN_GROUP_SIZE];
+
+void main()
+{
+    uint lane = gl_LocalInvocationID.x;
+
+    // Each invocation sums a contiguous run of counts
+    uint perLane = (offsetCount + SCAN_GROUP_SIZE - 1u) / SCAN_GROUP_SIZE;
+    uint begin = min(lane * perLane, offsetCount);
+    uint end = min(begin + perLane, offsetCount);
+
+    uint sum = 0u;
+    for (uint i = begin; i < end; i++)
+        sum += offsets[i];
+
+    partial[lane] = sum;
+    barrier();
+
+    for (uint offset = 1u; offset < SCAN_GROUP_SIZE; offset *= 2u)
+    {
+        uint previous = lane >= offset ? partial[lane - offset] : 0u;
+        barrier();
+        partial[lane] += previous;
+        barrier();
+    }
+
+    // Exclusive prefix of the runs before this one, then of the counts within it
+    uint first = partial[lane] - sum;
+    for (uint i = begin; i < end; i++)
+    {
+        uint count = offsets[i];
+        offsets[i] = first;
+        first += count;
+    }
+}
@@ -0,0 +1,54 @@
+// Shared by the two diffuse passes. A workgroup loads BLUR_GROUP_SIZE texels along
+// one axis, which is BLUR_TILE outputs plus MAX_DIFFUSE_RADIUS on either side, and
+// box sums them with a prefix scan, so the cost does not grow with the radius.
+// MAX_DIFFUSE_RADIUS must match SimulationBackend.hpp.
+
+#define BLUR_GROUP_SIZE 256
+#define MAX_DIFFUSE_RADIUS 16
+#define BLUR_TILE (BLUR_GROUP_SIZE - 2 * MAX_DIFFUSE_RADIUS)
+
+shared float prefix[BLUR_GROUP_SIZE];
+
+// Sum of the values held by lanes [lane - radius, lane + radius].
+// Must be reached by every invocation in the workgroup.
+float boxSum(float value, int lane, int radius)
+{
+    prefix[lane] = value;
+    barrier();
+
+#ifdef DIFFUSE_RADIUS
+    // With the radius fixed at compile time, a small window is cheaper to add up
+    // directly than to scan, and the loop unrolls
+    float sum = 0.0;
+    for (int offset = -DIFFUSE_RADIUS; offset <= DIFFUSE_RADIUS; offset++)
+    {
+        int neighbour = lane + offset;
+        if (neighbour >= 0 && neighbour < BLUR_GROUP_SIZE)
+            sum += prefix[neighbour];
+    }
+    return sum;
+#else
+    for (int offset = 1; offset < BLUR_GROUP_SIZE; offset *= 2)
+    {
+        float previous = lane >= offset ? prefix[lane - offset] : 0.0;
+        barrier();
+        prefix[lane] += previous;
+        barrier();
+    }
+
+    float upper = prefix[min(lane + radius, BLUR_GROUP_SIZE - 1)];
+    float lower = lane - radius - 1 >= 0 ? prefix[lane - radius - 1] : 0.0;
+    return upper - lower;
+#endif
+}
+
+// Number of texels of [position - radius, position + radius] inside [0, size)
+float windowCount(int position, int radius, int size)
+{
+    return float(min(position + radius, size - 1) - max(position - radius, 0) + 1);
+}
+
+bool isOutputLane(int lane)
+{
+    return lane >= MAX_DIFFUSE_RADIUS && lane < MAX_DIFFUSE_RADIUS + BLUR_TILE;
+}
@@ -0,0 +1,15 @@
+// In accumulate mode agents count their deposits with imageAtomicAdd instead of
+// writing the trail map, and the diffuse passes add the counts in as they read it.
+// Expects inputTexture to be declared first.
+
+#include "simulationParams.glsl"
+
+layout (binding = 3, r32ui) uniform uimage2D depositCounts;
+
+float loadStrength(ivec2 px)
+{
+    float strength = imageLoad(inputTexture, px).r;
+    if (ACCUMULATE_DEPOSITS)
+        strength += float(imageLoad(depositCounts, px).r) * depositAmount;
+    return strength;
+}
@@ -0,0 +1,25 @@
+#version 430
+
+#include "boxSum.glsl"
+
+layout (local_size_x = BLUR_GROUP_SIZE, local_size_y = 1) in;
+
+layout (binding = 0, r32f) uniform image2D inputTexture;
+layout (binding = 2, r32f) uniform image2D blurTexture;
+
+#include "deposits.glsl"
+
+// Horizontal half of the diffuse, averaged over the texels inside the image
+void main()
+{
+    ivec2 size = imageSize(inputTexture);
+
+    int lane = int(gl_LocalInvocationID.x);
+    ivec2 px = ivec2(int(gl_WorkGroupID.x) * BLUR_TILE + lane - MAX_DIFFUSE_RADIUS, gl_WorkGroupID.y);
+
+    // imageLoad returns zero outside the image
+    float sum = boxSum(loadStrength(px), lane, BLUR_RADIUS);
+
+    if (isOutputLane(lane) && px.x < size.x)
+        imageStore(blurTexture, px, vec4(sum / windowCount(px.x, BLUR_RADIUS, size.x)));
+}
@@ -1,47 +1,38 @@
 #version 430
 
-layout (local_size_x = 8, local_size_y = 8) in;
+#include "boxSum.glsl"
 
-layout (binding = 0, rgba32f) uniform image2D inputTexture;
-layout (binding = 1, rgba32f) uniform image2D outputTexture;
+layout (local_size_x = 1, local_size_y = BLUR_GROUP_SIZE) in;
 
-uniform float decayAmount;
-uniform float diffuseSpeed;
-uniform float deltaTime;
+layout (binding = 0, r32f) uniform image2D inputTexture;
+layout (binding = 1, r32f) uniform image2D outputTexture;
+layout (binding = 2, r32f) uniform image2D blurTexture;
 
+#include "deposits.glsl"
+
+// Vertical half of the diffuse, followed by the decay
 void main()
 {
-    ivec2 px = ivec2(gl_GlobalInvocationID.xy);
     ivec2 size = imageSize(inputTexture);
 
-    vec4 original = imageLoad(inputTexture, px);
-    vec4 colour = original;
+    int lane = int(gl_LocalInvocationID.y);
+    ivec2 px = ivec2(gl_WorkGroupID.x, int(gl_WorkGroupID.y) * BLUR_TILE + lane - MAX_DIFFUSE_RADIUS);
+
+    float sum = boxSum(imageLoad(blurTexture, px).r, lane, BLUR_RADIUS);
+
+    if (!isOutputLane(lane) || px.y >= size.y)
+        return;
 
-    int kernal = 1;
+    float original = loadStrength(px);
+
+    // Last pass to read the counts, so clear them for the next step
+    if (ACCUMULATE_DEPOSITS)
+        imageStore(depositCounts, px, uvec4(0));
 
     // Diffuse
-    if (px.x >= 1 && px.y >= 1 && px.x < size.x && px.y < size.y)
-    {
-        float count = 1.0;
-        for (int i = -kernal; i <= kernal; i++)
-        {
-            for (int j = -kernal; j <= kernal; j++)
-            {
-                if (i == 0 && j == 0)
-                    continue;
-                
-                colour += imageLoad(inputTexture, ivec2(px.x + i, px.y + j));
-                count += 1.0;
-            }
-        }
-
-        colour /= count;
-    }
-
-
-    colour = mix(original, colour, diffuseSpeed);
-
-    vec4 final = max(vec4(0.0), colour - decayAmount * deltaTime);
-
-    imageStore(outputTexture, px, vec4(final.rgb, 1.0));
-}
\ No newline at end of file
+    float strength = mix(original, sum / windowCount(px.y, BLUR_RADIUS, size.y), diffuseSpeed);
+
+    float final = max(0.0, strength - decayAmount * deltaTime);
+
+    imageStore(outputTexture, px, vec4(final));
+}
@@ -3,8 +3,10 @@ in vec2 texCoords;
 out vec4 colour;
 
 uniform sampler2D tex;
+uniform vec4 slimeColour;
 
+// The trail map only holds a strength, so colour is applied here
 void main()
 {
-    colour = texture(tex, texCoords);
+    colour = vec4(texture(tex, texCoords).r * slimeColour.rgb, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+// Philox2x32-10, bit-identical to src/Random.hpp
+
+const uint RANDOM_STREAM_SPAWN = 0x00000000u;
+const uint RANDOM_STREAM_AGENT = 0x1B873593u;
+
+uvec2 philox(uvec2 counter, uint key)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint hi, lo;
+        umulExtended(0xD256D193u, counter.x, hi, lo);
+
+        counter = uvec2(hi ^ key ^ counter.y, lo);
+        key += 0x9E3779B9u;
+    }
+
+    return counter;
+}
+
+// Uniform float in [0, 1) using the top 24 bits, so it is exact in single precision
+float uniformFloat(uint bits)
+{
+    return float(bits >> 8) * (1.0 / 16777216.0);
+}
@@ -0,0 +1,41 @@
+#ifndef SIMULATION_PARAMS_GLSL
+#define SIMULATION_PARAMS_GLSL
+
+// Settings shared by the agent and diffuse passes, written once per step by
+// GpuBackend. Must match GpuBackend::simulationParams.
+layout (std140, binding = 0) uniform simulationParams
+{
+    int agentCount;
+    uint stepIndex;
+    uint seed;
+    float deltaTime;
+
+    float movementDistance;
+    float sensorDistance;
+    float sensorAngle;
+    float rotationAngle;
+
+    // Overwriting loses deposits when agents share a pixel, counting them does not
+    bool accumulateDeposits;
+    float depositAmount;
+    int radius;
+    float decayAmount;
+
+    float diffuseSpeed;
+};
+
+// Variants compiled for one deposit mode or diffuse radius, see GpuBackend::getAgentDefines,
+// use a constant in place of the uniform, so the compiler can fold it
+#ifdef ACCUMULATE
+#define ACCUMULATE_DEPOSITS (ACCUMULATE != 0)
+#else
+#define ACCUMULATE_DEPOSITS accumulateDeposits
+#endif
+
+#ifdef DIFFUSE_RADIUS
+#define BLUR_RADIUS DIFFUSE_RADIUS
+#else
+#define BLUR_RADIUS radius
+#endif
+
+#endif
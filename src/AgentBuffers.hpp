@@ -0,0 +1,183 @@
+#ifndef AGENT_BUFFERS_HPP
+#define AGENT_BUFFERS_HPP
+
+#include <GLAD/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// The GPU backend's agent x, y and angle storage buffers.
+//
+// Agents are written on the host into staging memory, then only the range that
+// changed is copied into the buffers the shaders use. With ARB_buffer_storage the
+// staging buffers are persistently mapped, so the host writes straight into memory
+// the GPU copies from. Without it, staging is ordinary host memory uploaded with
+// glBufferSubData. Either way nothing is reallocated until the capacity is exceeded.
+//
+// The shader buffers are not mapped themselves: the agent pass reads and writes all
+// of them every step, and mapped buffers may be placed in host memory.
+class AgentBuffers
+{
+public:
+    static const int FIELDS = 3;
+private:
+    // The agents, and a spare set the sort scatters into before the two swap
+    unsigned int buffers[2][FIELDS];
+    unsigned int current = 0;
+
+    unsigned int staging[FIELDS];
+    float* mapped[FIELDS] = { nullptr, nullptr, nullptr };
+    std::vector<float> hostStaging[FIELDS];
+
+    size_t capacity = 0;
+    bool persistent;
+    // Set after copying out of the persistently mapped staging buffers
+    GLsync uploadFence = 0;
+public:
+    AgentBuffers()
+    {
+        persistent = GLAD_GL_ARB_buffer_storage;
+
+        glGenBuffers(FIELDS, buffers[0]);
+        glGenBuffers(FIELDS, buffers[1]);
+        glGenBuffers(FIELDS, staging);
+    }
+
+    ~AgentBuffers()
+    {
+        if (uploadFence)
+            glDeleteSync(uploadFence);
+
+        // Deleting a mapped buffer unmaps it
+        glDeleteBuffers(FIELDS, staging);
+        glDeleteBuffers(FIELDS, buffers[1]);
+        glDeleteBuffers(FIELDS, buffers[0]);
+    }
+
+    AgentBuffers(const AgentBuffers&) = delete;
+    AgentBuffers& operator=(const AgentBuffers&) = delete;
+
+    size_t getCapacity() const { return capacity; }
+    bool isPersistent() const { return persistent; }
+
+    unsigned int getBuffer(int field) const { return buffers[current][field]; }
+    unsigned int getSpareBuffer(int field) const { return buffers[1 - current][field]; }
+
+    // Makes the spare set the agents, once the sort has filled it
+    void swap() { current = 1 - current; }
+
+    // Grows every buffer to hold at least count agents, keeping agents [0, keep).
+    // Any shader writes to the agents need a buffer update barrier first.
+    void reserve(size_t count, size_t keep)
+    {
+        if (count <= capacity)
+            return;
+
+        waitForUploads();
+
+        const GLsizeiptr bytes = count * sizeof(float);
+        for (int field = 0; field < FIELDS; field++)
+        {
+            unsigned int grown[2];
+            glGenBuffers(2, grown);
+            for (unsigned int buffer : grown)
+            {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                if (persistent)
+                    glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, NULL, 0);
+                else
+                    glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+            }
+
+            // The spare set is overwritten by every sort, so only the agents are copied
+            if (keep > 0)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffers[current][field]);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, grown[current]);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keep * sizeof(float));
+            }
+
+            glDeleteBuffers(1, &buffers[0][field]);
+            glDeleteBuffers(1, &buffers[1][field]);
+            buffers[0][field] = grown[0];
+            buffers[1][field] = grown[1];
+
+            if (persistent)
+            {
+                // Immutable storage cannot grow, so staging gets a new buffer too
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+                glDeleteBuffers(1, &staging[field]);
+                glGenBuffers(1, &staging[field]);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, staging[field]);
+                glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, NULL, flags);
+                mapped[field] = (float*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+            }
+            else
+            {
+                hostStaging[field].resize(count);
+                mapped[field] = hostStaging[field].data();
+            }
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        capacity = count;
+    }
+
+    // Host memory for one field of agents [0, capacity). Call waitForUploads before
+    // writing to it, then upload the range written.
+    float* getStaging(int field) { return mapped[field]; }
+
+    // Blocks until the GPU has finished copying out of staging, so it can be written again
+    void waitForUploads()
+    {
+        if (!uploadFence)
+            return;
+
+        while (glClientWaitSync(uploadFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+
+        glDeleteSync(uploadFence);
+        uploadFence = 0;
+    }
+
+    // Copies agents [begin, end) from staging into the agents the shaders use. Any shader
+    // writes to that range need a buffer update barrier first.
+    void upload(size_t begin, size_t end)
+    {
+        if (end <= begin)
+            return;
+
+        const GLintptr offset = begin * sizeof(float);
+        const GLsizeiptr size = (end - begin) * sizeof(float);
+
+        for (int field = 0; field < FIELDS; field++)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[current][field]);
+            if (persistent)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, staging[field]);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, offset, size);
+            }
+            else
+            {
+                glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, mapped[field] + begin);
+            }
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        if (persistent)
+        {
+            if (uploadFence)
+                glDeleteSync(uploadFence);
+            uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "AgentKernel.hpp"
+
+namespace
+{
+    bool cpuSupports(agentKernelType type)
+    {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        if (type == agentKernelType::AVX2)
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        if (type == agentKernelType::AVX512)
+            return __builtin_cpu_supports("avx512f");
+#endif
+        (void)type;
+        return false;
+    }
+}
+
+AgentKernel getAgentKernel(agentKernelType type)
+{
+    switch (type)
+    {
+    case agentKernelType::AUTO:
+        if (AgentKernel kernel = getAgentKernel(agentKernelType::AVX512))
+            return kernel;
+        return getAgentKernel(agentKernelType::AVX2);
+    case agentKernelType::AVX2:
+        return cpuSupports(type) ? getAgentKernelAvx2() : nullptr;
+    case agentKernelType::AVX512:
+        return cpuSupports(type) ? getAgentKernelAvx512() : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+const char* getAgentKernelName(agentKernelType type)
+{
+    switch (type)
+    {
+    case agentKernelType::AUTO: return "Auto";
+    case agentKernelType::SCALAR: return "Scalar";
+    case agentKernelType::AVX2: return "AVX2";
+    case agentKernelType::AVX512: return "AVX-512";
+    }
+    return "";
+}
@@ -0,0 +1,65 @@
+#ifndef AGENT_KERNEL_HPP
+#define AGENT_KERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorised CPU agent kernels. The AVX2 and AVX-512 versions live in their own
+// translation units built with the matching instruction set flags, so this header
+// must stay free of anything that could be inlined into them from elsewhere.
+//
+// The kernels use polynomial sin/cos instead of the C library and share one
+// sin/cos pair between the three sensors. Starting from the same state, one step
+// matches CpuSimulation's scalar loop to within AGENT_KERNEL_POSITION_TOLERANCE in
+// position and AGENT_KERNEL_ANGLE_TOLERANCE in angle, or 2 * FLT_EPSILON of the value
+// where that is larger, as floats past 512 are coarser than the tolerance. The only
+// exception is an agent whose sensor sample lands within the position tolerance of a
+// pixel edge, which can read the neighbouring pixel and turn the other way.
+// slime_bench --verify-kernels checks this.
+
+// Pixels and degrees
+const float AGENT_KERNEL_POSITION_TOLERANCE = 1e-4f;
+const float AGENT_KERNEL_ANGLE_TOLERANCE = 1e-4f;
+
+enum class agentKernelType
+{
+    AUTO,
+    SCALAR,
+    AVX2,
+    AVX512
+};
+
+struct AgentKernelParams
+{
+    float* x;
+    float* y;
+    float* angle;
+
+    // Trail strength, one float per pixel
+    const float* trail;
+    int width, height;
+
+    float movementDistance;
+    float deltaTime;
+    float sensorDistance;
+    float sensorCos, sensorSin;
+    float rotationAngle;
+
+    uint32_t key;
+    uint32_t step;
+};
+
+// Updates agents [begin, end) and writes the pixel each one deposits on to
+// deposits[i - begin], or -1 when it is outside the trail map
+typedef void (*AgentKernel)(const AgentKernelParams& params, size_t begin, size_t end, int32_t* deposits);
+
+// Returns nullptr for SCALAR, or when the instruction set is not available on this CPU or compiler.
+// AUTO picks the widest available one.
+AgentKernel getAgentKernel(agentKernelType type);
+
+const char* getAgentKernelName(agentKernelType type);
+
+AgentKernel getAgentKernelAvx2();
+AgentKernel getAgentKernelAvx512();
+
+#endif
@@ -0,0 +1,97 @@
+// Built with -mavx2 -mfma, see CMakeLists.txt
+
+#include "AgentKernel.hpp"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#include "AgentKernelSimd.hpp"
+
+namespace
+{
+    struct Avx2
+    {
+        static const int WIDTH = 8;
+
+        typedef __m256 F;
+        typedef __m256i I;
+        typedef __m256 M;
+
+        static F load(const float* p) { return _mm256_loadu_ps(p); }
+        static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+        static void storeInt(int32_t* p, I v) { _mm256_storeu_si256((__m256i*)p, v); }
+
+        static F set(float v) { return _mm256_set1_ps(v); }
+        static I seti(int32_t v) { return _mm256_set1_epi32(v); }
+        static I laneIndex() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+
+        static F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static F min(F a, F b) { return _mm256_min_ps(a, b); }
+        static F max(F a, F b) { return _mm256_max_ps(a, b); }
+        static F round(F v) { return _mm256_round_ps(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+        static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static M ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+
+        static M andMask(M a, M b) { return _mm256_and_ps(a, b); }
+        static M orMask(M a, M b) { return _mm256_or_ps(a, b); }
+        // !a && b
+        static M andNotMask(M a, M b) { return _mm256_andnot_ps(a, b); }
+
+        static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+        static I selecti(M m, I a, I b) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m)); }
+
+        static I truncate(F v) { return _mm256_cvttps_epi32(v); }
+        static F toFloat(I v) { return _mm256_cvtepi32_ps(v); }
+
+        static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+        static I muli(I a, I b) { return _mm256_mullo_epi32(a, b); }
+        static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+        static I xori(I a, I b) { return _mm256_xor_si256(a, b); }
+        static I srli(I v, int n) { return _mm256_srli_epi32(v, n); }
+
+        static M eqi(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+        static M lti(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a)); }
+        static M gei(I a, I b) { return _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(a, b), _mm256_cmpeq_epi32(a, b))); }
+
+        static F gather(const float* base, I index, M mask)
+        {
+            return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, mask, 4);
+        }
+
+        // Full 32x32 -> 64 bit products, split into high and low words
+        static void mulhilo(I a, uint32_t b, I& hi, I& lo)
+        {
+            I multiplier = _mm256_set1_epi32((int32_t)b);
+            I even = _mm256_mul_epu32(a, multiplier);
+            I odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), multiplier);
+
+            lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+            hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+        }
+    };
+
+    void agentKernelAvx2(const AgentKernelParams& params, size_t begin, size_t end, int32_t* deposits)
+    {
+        runAgentKernel<Avx2>(params, begin, end, deposits);
+    }
+}
+
+AgentKernel getAgentKernelAvx2()
+{
+    return agentKernelAvx2;
+}
+
+#else
+
+AgentKernel getAgentKernelAvx2()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,97 @@
+// Built with -mavx512f, see CMakeLists.txt
+
+#include "AgentKernel.hpp"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+#include "AgentKernelSimd.hpp"
+
+namespace
+{
+    struct Avx512
+    {
+        static const int WIDTH = 16;
+
+        typedef __m512 F;
+        typedef __m512i I;
+        typedef __mmask16 M;
+
+        static F load(const float* p) { return _mm512_loadu_ps(p); }
+        static void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+        static void storeInt(int32_t* p, I v) { _mm512_storeu_si512((void*)p, v); }
+
+        static F set(float v) { return _mm512_set1_ps(v); }
+        static I seti(int32_t v) { return _mm512_set1_epi32(v); }
+        static I laneIndex() { return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+
+        static F add(F a, F b) { return _mm512_add_ps(a, b); }
+        static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+        static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+        static F min(F a, F b) { return _mm512_min_ps(a, b); }
+        static F max(F a, F b) { return _mm512_max_ps(a, b); }
+        static F round(F v) { return _mm512_roundscale_ps(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+        static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+        static M ge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+
+        static M andMask(M a, M b) { return a & b; }
+        static M orMask(M a, M b) { return a | b; }
+        // !a && b
+        static M andNotMask(M a, M b) { return (M)(~a & b); }
+
+        static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+        static I selecti(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+
+        static I truncate(F v) { return _mm512_cvttps_epi32(v); }
+        static F toFloat(I v) { return _mm512_cvtepi32_ps(v); }
+
+        static I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+        static I muli(I a, I b) { return _mm512_mullo_epi32(a, b); }
+        static I andi(I a, I b) { return _mm512_and_si512(a, b); }
+        static I xori(I a, I b) { return _mm512_xor_si512(a, b); }
+        static I srli(I v, int n) { return _mm512_srli_epi32(v, n); }
+
+        static M eqi(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+        static M lti(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+        static M gei(I a, I b) { return _mm512_cmpge_epi32_mask(a, b); }
+
+        static F gather(const float* base, I index, M mask)
+        {
+            return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, base, 4);
+        }
+
+        // Full 32x32 -> 64 bit products, split into high and low words
+        static void mulhilo(I a, uint32_t b, I& hi, I& lo)
+        {
+            I multiplier = _mm512_set1_epi32((int32_t)b);
+            I even = _mm512_mul_epu32(a, multiplier);
+            I odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), multiplier);
+
+            lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+            hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+        }
+    };
+
+    void agentKernelAvx512(const AgentKernelParams& params, size_t begin, size_t end, int32_t* deposits)
+    {
+        runAgentKernel<Avx512>(params, begin, end, deposits);
+    }
+}
+
+AgentKernel getAgentKernelAvx512()
+{
+    return agentKernelAvx512;
+}
+
+#else
+
+AgentKernel getAgentKernelAvx512()
+{
+    return nullptr;
+}
+
+#endif
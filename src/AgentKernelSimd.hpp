@@ -0,0 +1,206 @@
+#ifndef AGENT_KERNEL_SIMD_HPP
+#define AGENT_KERNEL_SIMD_HPP
+
+// Instruction set independent body of the vectorised agent kernel. Only included
+// by the per-ISA translation units, each of which supplies a traits type V wrapping
+// its intrinsics. Everything here is a template over V, and V lives in an
+// anonymous namespace, so nothing compiled with wider instructions can leak out.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "AgentKernel.hpp"
+
+namespace
+{
+    template <class V>
+    inline typename V::F negateIf(typename V::M mask, typename V::F value)
+    {
+        return V::select(mask, V::sub(V::set(0.0f), value), value);
+    }
+
+    // Cody-Waite reduction to [-pi/4, pi/4] followed by the Cephes sinf/cosf polynomials
+    template <class V>
+    inline void sinCos(typename V::F x, typename V::F& sinOut, typename V::F& cosOut)
+    {
+        typedef typename V::F F;
+        typedef typename V::I I;
+
+        F quadrant = V::round(V::mul(x, V::set(0.636619772367581f)));
+        I q = V::truncate(quadrant);
+
+        F r = V::sub(x, V::mul(quadrant, V::set(1.5703125f)));
+        r = V::sub(r, V::mul(quadrant, V::set(4.837512969970703125e-4f)));
+        r = V::sub(r, V::mul(quadrant, V::set(7.54978995489188216e-8f)));
+
+        F r2 = V::mul(r, r);
+
+        F s = V::add(V::set(8.3321608736e-3f), V::mul(r2, V::set(-1.9515295891e-4f)));
+        s = V::add(V::set(-1.6666654611e-1f), V::mul(r2, s));
+        s = V::add(r, V::mul(V::mul(r, r2), s));
+
+        F c = V::add(V::set(-1.388731625493765e-3f), V::mul(r2, V::set(2.443315711809948e-5f)));
+        c = V::add(V::set(4.166664568298827e-2f), V::mul(r2, c));
+        c = V::add(V::sub(V::set(1.0f), V::mul(V::set(0.5f), r2)), V::mul(V::mul(r2, r2), c));
+
+        typename V::M swap = V::eqi(V::andi(q, V::seti(1)), V::seti(1));
+        sinOut = V::select(swap, c, s);
+        cosOut = V::select(swap, s, c);
+
+        sinOut = negateIf<V>(V::eqi(V::andi(q, V::seti(2)), V::seti(2)), sinOut);
+        cosOut = negateIf<V>(V::eqi(V::andi(V::addi(q, V::seti(1)), V::seti(2)), V::seti(2)), cosOut);
+    }
+
+    // Same rounds as philox() in Random.hpp, one stream per lane
+    template <class V>
+    inline void philox(typename V::I counter0, typename V::I counter1, uint32_t key, typename V::I& outX, typename V::I& outY)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            typename V::I hi, lo;
+            V::mulhilo(counter0, 0xD256D193u, hi, lo);
+
+            counter0 = V::xori(V::xori(hi, V::seti((int32_t)key)), counter1);
+            counter1 = lo;
+            key += 0x9E3779B9u;
+        }
+
+        outX = counter0;
+        outY = counter1;
+    }
+
+    template <class V>
+    inline typename V::F uniformFloat(typename V::I bits)
+    {
+        return V::mul(V::toFloat(V::srli(bits, 8)), V::set(1.0f / 16777216.0f));
+    }
+
+    // Trail strength at each lane's pixel, zero outside the map
+    template <class V>
+    inline typename V::F sense(const AgentKernelParams& p, typename V::F sx, typename V::F sy)
+    {
+        typename V::I ix = V::truncate(sx);
+        typename V::I iy = V::truncate(sy);
+
+        typename V::M inside = V::andMask(
+            V::andMask(V::gei(ix, V::seti(0)), V::gei(iy, V::seti(0))),
+            V::andMask(V::lti(ix, V::seti(p.width)), V::lti(iy, V::seti(p.height))));
+
+        typename V::I index = V::addi(V::muli(iy, V::seti(p.width)), ix);
+        return V::gather(p.trail, index, inside);
+    }
+
+    // Updates V::WIDTH agents whose fields are at xs/ys/angles, the first having index `first`
+    template <class V>
+    inline void stepAgents(const AgentKernelParams& p, float* xs, float* ys, float* angles, uint32_t first, int32_t* deposits)
+    {
+        typedef typename V::F F;
+        typedef typename V::I I;
+        typedef typename V::M M;
+
+        F x = V::load(xs);
+        F y = V::load(ys);
+        F angle = V::load(angles);
+
+        F sinA, cosA;
+        sinCos<V>(V::mul(angle, V::set(0.017453292519943295f)), sinA, cosA);
+
+        // Movement Stage
+        F newX = V::add(x, V::mul(V::mul(V::set(p.movementDistance), cosA), V::set(p.deltaTime)));
+        F newY = V::add(y, V::mul(V::mul(V::set(p.movementDistance), sinA), V::set(p.deltaTime)));
+
+        I bitsX, bitsY;
+        philox<V>(V::addi(V::seti((int32_t)first), V::laneIndex()), V::seti((int32_t)p.step), p.key, bitsX, bitsY);
+        F rnd = uniformFloat<V>(bitsX);
+        F r = uniformFloat<V>(bitsY);
+
+        F width = V::set((float)p.width);
+        F height = V::set((float)p.height);
+        F zero = V::set(0.0f);
+
+        M outside = V::orMask(
+            V::orMask(V::ge(newX, width), V::le(newX, zero)),
+            V::orMask(V::ge(newY, height), V::le(newY, zero)));
+
+        newX = V::select(outside, V::min(V::max(newX, zero), V::sub(width, V::set(1.0f))), newX);
+        newY = V::select(outside, V::min(V::max(newY, zero), V::sub(height, V::set(1.0f))), newY);
+
+        F bounced = V::add(V::set(180.0f), V::sub(V::mul(rnd, V::set(30.0f)), V::set(15.0f)));
+        F newAngle = V::select(outside, bounced, angle);
+
+        V::store(xs, newX);
+        V::store(ys, newY);
+
+        // Deposit on the pixel the agent started from
+        I depositX = V::truncate(x);
+        I depositY = V::truncate(y);
+        M depositInside = V::andMask(
+            V::andMask(V::gei(depositX, V::seti(0)), V::gei(depositY, V::seti(0))),
+            V::andMask(V::lti(depositX, V::seti(p.width)), V::lti(depositY, V::seti(p.height))));
+        V::storeInt(deposits, V::selecti(depositInside, V::addi(V::muli(depositY, V::seti(p.width)), depositX), V::seti(-1)));
+
+        // Sensory Stage, with the side sensors rotated by the angle addition identities
+        F sensorCos = V::set(p.sensorCos);
+        F sensorSin = V::set(p.sensorSin);
+        F distance = V::set(p.sensorDistance);
+
+        F cosLeft = V::add(V::mul(cosA, sensorCos), V::mul(sinA, sensorSin));
+        F sinLeft = V::sub(V::mul(sinA, sensorCos), V::mul(cosA, sensorSin));
+        F cosRight = V::sub(V::mul(cosA, sensorCos), V::mul(sinA, sensorSin));
+        F sinRight = V::add(V::mul(sinA, sensorCos), V::mul(cosA, sensorSin));
+
+        F front = sense<V>(p, V::add(x, V::mul(distance, cosA)), V::add(y, V::mul(distance, sinA)));
+        F frontLeft = sense<V>(p, V::add(x, V::mul(distance, cosLeft)), V::add(y, V::mul(distance, sinLeft)));
+        F frontRight = sense<V>(p, V::add(x, V::mul(distance, cosRight)), V::add(y, V::mul(distance, sinRight)));
+
+        F turn = V::mul(V::set(p.rotationAngle), rnd);
+
+        M randomTurn = V::andMask(V::lt(front, frontLeft), V::lt(front, frontRight));
+        M turnLeft = V::orMask(
+            V::andMask(randomTurn, V::lt(r, V::set(0.5f))),
+            V::andNotMask(randomTurn, V::gt(frontLeft, frontRight)));
+        M turnRight = V::orMask(
+            V::andNotMask(V::lt(r, V::set(0.5f)), randomTurn),
+            V::andNotMask(randomTurn, V::andNotMask(V::gt(frontLeft, frontRight), V::gt(frontRight, frontLeft))));
+
+        newAngle = V::select(turnLeft, V::sub(newAngle, turn), newAngle);
+        newAngle = V::select(turnRight, V::add(newAngle, turn), newAngle);
+
+        V::store(angles, newAngle);
+    }
+
+    template <class V>
+    void runAgentKernel(const AgentKernelParams& p, size_t begin, size_t end, int32_t* deposits)
+    {
+        size_t i = begin;
+        for (; i + V::WIDTH <= end; i += V::WIDTH)
+            stepAgents<V>(p, p.x + i, p.y + i, p.angle + i, (uint32_t)i, deposits + (i - begin));
+
+        size_t remaining = end - i;
+        if (remaining == 0)
+            return;
+
+        // Run the tail through padded copies so every lane reads valid memory
+        float xs[V::WIDTH], ys[V::WIDTH], angles[V::WIDTH];
+        int32_t tailDeposits[V::WIDTH];
+        for (int lane = 0; lane < V::WIDTH; lane++)
+        {
+            size_t source = lane < (int)remaining ? i + lane : i;
+            xs[lane] = p.x[source];
+            ys[lane] = p.y[source];
+            angles[lane] = p.angle[source];
+        }
+
+        stepAgents<V>(p, xs, ys, angles, (uint32_t)i, tailDeposits);
+
+        for (size_t lane = 0; lane < remaining; lane++)
+        {
+            p.x[i + lane] = xs[lane];
+            p.y[i + lane] = ys[lane];
+            p.angle[i + lane] = angles[lane];
+            deposits[i - begin + lane] = tailDeposits[lane];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef AGENT_SPAWNER_HPP
+#define AGENT_SPAWNER_HPP
+
+#include <GLM/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+#include "AgentStore.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+
+enum class generationType
+{
+    IN_CIRCLE,
+    OUT_CIRCLE,
+    RANDOM
+};
+
+struct SpawnSettings
+{
+    generationType type;
+    float radius;
+    unsigned int width, height;
+    uint32_t seed;
+};
+
+// Agent `index` only depends on the settings and the index, so agents can be
+// generated in any order, on any thread, and come out the same every time.
+inline agent spawnAgent(const SpawnSettings& settings, uint32_t index)
+{
+    const uint32_t key = settings.seed ^ RANDOM_STREAM_SPAWN;
+
+    philox2x32 bits = philox(index, 0, key);
+    float u0 = uniformFloat(bits.x);
+    float u1 = uniformFloat(bits.y);
+
+    agent a;
+    if (settings.type == generationType::RANDOM)
+    {
+        a.pos = glm::vec2(u0 * settings.width, u1 * settings.height);
+        a.angle = uniformFloat(philox(index, 1, key).x) * 360.0f;
+        return a;
+    }
+
+    float radius = u0 * settings.radius;
+    float angle = u1 * 360.0f;
+    float radians = glm::radians(angle);
+
+    a.pos.x = (settings.width  / 2) + (radius * std::cos(radians));
+    a.pos.y = (settings.height / 2) + (radius * std::sin(radians));
+    a.angle = settings.type == generationType::IN_CIRCLE ? angle + 180.0f : angle;
+    return a;
+}
+
+// Fills agents [begin, end) of an already sized store
+inline void spawnAgents(ThreadPool& pool, const SpawnSettings& settings, AgentStore& agents, size_t begin, size_t end)
+{
+    pool.parallelFor(end - begin, 1 << 15, [&](size_t chunkBegin, size_t chunkEnd, unsigned int)
+    {
+        for (size_t i = begin + chunkBegin; i < begin + chunkEnd; i++)
+            agents.set(i, spawnAgent(settings, (uint32_t)i));
+    });
+}
+
+// Fills agents [begin, end) of separate x, y and angle arrays, such as mapped buffers
+inline void spawnAgents(ThreadPool& pool, const SpawnSettings& settings, float* x, float* y, float* angle, size_t begin, size_t end)
+{
+    pool.parallelFor(end - begin, 1 << 15, [&](size_t chunkBegin, size_t chunkEnd, unsigned int)
+    {
+        for (size_t i = begin + chunkBegin; i < begin + chunkEnd; i++)
+        {
+            agent a = spawnAgent(settings, (uint32_t)i);
+            x[i] = a.pos.x;
+            y[i] = a.pos.y;
+            angle[i] = a.angle;
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef AGENT_STORE_HPP
+#define AGENT_STORE_HPP
+
+#include <GLM/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct agent
+{
+    glm::vec2 pos;
+    float angle;
+};
+
+enum class agentPrecision
+{
+    FLOAT32, // x, y and angle as floats, 12 bytes per agent
+    FIXED16  // x and y packed as 16 bit fractions of the trail size, 8 bytes per agent
+};
+
+// Structure of arrays agent storage. Each field is its own contiguous array so
+// a pass only streams the bytes it actually uses.
+class AgentStore
+{
+public:
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> angle;
+
+    // Replaces x and y with agentPrecision::FIXED16, x in the low half
+    std::vector<uint32_t> position;
+private:
+    agentPrecision precision = agentPrecision::FLOAT32;
+    glm::vec2 toFixed = glm::vec2(1.0f);
+    glm::vec2 fromFixed = glm::vec2(1.0f);
+public:
+    AgentStore() {}
+
+    size_t size() const { return angle.size(); }
+    size_t capacity() const { return angle.capacity(); }
+    agentPrecision getPrecision() const { return precision; }
+
+    size_t getBytesPerAgent() const
+    {
+        return precision == agentPrecision::FIXED16 ? sizeof(uint32_t) + sizeof(float) : 3 * sizeof(float);
+    }
+
+    void resize(size_t count)
+    {
+        angle.resize(count);
+        if (precision == agentPrecision::FIXED16)
+        {
+            position.resize(count);
+        }
+        else
+        {
+            x.resize(count);
+            y.resize(count);
+        }
+    }
+
+    void reserve(size_t count)
+    {
+        angle.reserve(count);
+        if (precision == agentPrecision::FIXED16)
+        {
+            position.reserve(count);
+        }
+        else
+        {
+            x.reserve(count);
+            y.reserve(count);
+        }
+    }
+
+    // Overwrites agent to with agent from
+    void move(size_t to, size_t from)
+    {
+        angle[to] = angle[from];
+        if (precision == agentPrecision::FIXED16)
+        {
+            position[to] = position[from];
+        }
+        else
+        {
+            x[to] = x[from];
+            y[to] = y[from];
+        }
+    }
+
+    // Converts existing agents. width and height are the trail size positions are relative to.
+    void setPrecision(agentPrecision newPrecision, unsigned int width, unsigned int height)
+    {
+        glm::vec2 trailSize((float)width, (float)height);
+
+        if (newPrecision == precision)
+        {
+            toFixed = 65536.0f / trailSize;
+            fromFixed = trailSize / 65536.0f;
+            return;
+        }
+
+        if (newPrecision == agentPrecision::FIXED16)
+        {
+            toFixed = 65536.0f / trailSize;
+            fromFixed = trailSize / 65536.0f;
+
+            position.resize(size());
+            for (size_t i = 0; i < size(); i++)
+                position[i] = pack(glm::vec2(x[i], y[i]));
+
+            std::vector<float>().swap(x);
+            std::vector<float>().swap(y);
+        }
+        else
+        {
+            x.resize(size());
+            y.resize(size());
+            for (size_t i = 0; i < size(); i++)
+            {
+                glm::vec2 pos = unpack(position[i]);
+                x[i] = pos.x;
+                y[i] = pos.y;
+            }
+
+            std::vector<uint32_t>().swap(position);
+        }
+
+        precision = newPrecision;
+    }
+
+    glm::vec2 getPosition(size_t i) const
+    {
+        if (precision == agentPrecision::FIXED16)
+            return unpack(position[i]);
+        return glm::vec2(x[i], y[i]);
+    }
+
+    void setPosition(size_t i, glm::vec2 pos)
+    {
+        if (precision == agentPrecision::FIXED16)
+        {
+            position[i] = pack(pos);
+        }
+        else
+        {
+            x[i] = pos.x;
+            y[i] = pos.y;
+        }
+    }
+
+    void set(size_t i, const agent& a)
+    {
+        setPosition(i, a.pos);
+        angle[i] = a.angle;
+    }
+
+    uint32_t pack(glm::vec2 pos) const
+    {
+        glm::vec2 scaled = glm::max(pos * toFixed + 0.5f, glm::vec2(0.0f));
+        uint32_t fixedX = std::min(65535u, (uint32_t)scaled.x);
+        uint32_t fixedY = std::min(65535u, (uint32_t)scaled.y);
+        return fixedX | (fixedY << 16);
+    }
+
+    glm::vec2 unpack(uint32_t packed) const
+    {
+        return glm::vec2((float)(packed & 0xFFFF), (float)(packed >> 16)) * fromFixed;
+    }
+};
+
+// Removing agents down to newCount takes every (count / removed)th agent, so the
+// agents removed are spread over the whole population rather than being the last
+// ones, which after a sort would all be in one part of the trail map. The survivors
+// past newCount are moved into the gaps before truncating, as (to, from) pairs.
+// Takes O(count - newCount) time and leaves the other agents where they are.
+inline void getAgentRemovalMoves(size_t count, size_t newCount, std::vector<std::pair<uint32_t, uint32_t>>& moves)
+{
+    moves.clear();
+    if (newCount >= count)
+        return;
+
+    const size_t removed = count - newCount;
+    auto removedIndex = [&](size_t i) { return (size_t)((uint64_t)i * count / removed); };
+
+    // Removed agents are in increasing order, so the gaps below newCount come first
+    size_t tail = 0;
+    while (tail < removed && removedIndex(tail) < newCount)
+        tail++;
+
+    size_t from = newCount;
+    for (size_t i = 0; i < removed && removedIndex(i) < newCount; i++)
+    {
+        // Skips agents past newCount that are being removed themselves
+        while (tail < removed && removedIndex(tail) == from)
+        {
+            tail++;
+            from++;
+        }
+
+        moves.emplace_back((uint32_t)removedIndex(i), (uint32_t)from);
+        from++;
+    }
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef CPU_BACKEND_HPP
+#define CPU_BACKEND_HPP
+
+#include <GLAD/glad.h>
+
+#include <vector>
+
+#include "CpuSimulation.hpp"
+#include "Profiler.hpp"
+#include "SimulationBackend.hpp"
+
+// Runs the simulation on the host and uploads the trail map for display
+class CpuBackend : public SimulationBackend
+{
+private:
+    CpuSimulation simulation;
+    unsigned int texture;
+    bool dirty = true;
+public:
+    CpuBackend(ThreadPool& pool, unsigned int width, unsigned int height)
+        : simulation(pool, width, height)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        allocateTexture();
+    }
+
+    ~CpuBackend()
+    {
+        glDeleteTextures(1, &texture);
+    }
+
+    const char* getName() const override { return "CPU"; }
+
+    // Largest trail map the display texture can hold. Needs a current OpenGL context.
+    static glm::uvec2 getMaxTrailSize()
+    {
+        GLint maxTextureSize;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        return glm::uvec2(maxTextureSize);
+    }
+
+    void resize(unsigned int width, unsigned int height) override
+    {
+        simulation.resize(width, height);
+        allocateTexture();
+        dirty = true;
+    }
+
+    void reset(const AgentStore& agents) override
+    {
+        simulation.setAgents(agents);
+        simulation.clearTrail();
+        dirty = true;
+    }
+
+    void spawn(ThreadPool&, const SpawnSettings& settings, size_t count) override
+    {
+        simulation.spawnAgents(settings, count);
+        simulation.clearTrail();
+        dirty = true;
+    }
+
+    void setAgentCount(ThreadPool&, const SpawnSettings& settings, size_t count) override
+    {
+        simulation.setAgentCount(settings, count);
+    }
+
+    void step(const SimulationSettings& settings, float deltaTime) override
+    {
+        bool sorts = settings.sortInterval > 0 && simulation.getStepCount() % settings.sortInterval == 0;
+
+        simulation.step(settings, deltaTime);
+        dirty = true;
+
+        if (profiler)
+        {
+            if (sorts)
+                addPass("Sort", simulation.getSortTimer());
+            addPass("Agents", simulation.getAgentPassTimer());
+            addPass("Deposits", simulation.getDepositPassTimer());
+            addPass("Diffuse", simulation.getDiffusePassTimer());
+        }
+    }
+
+    unsigned int getTexture() override
+    {
+        if (dirty)
+        {
+            CpuTimerScope cpuTimer(profiler, "Copy");
+            GpuTimerScope gpuTimer(profiler, "Copy");
+
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, simulation.getWidth(), simulation.getHeight(), GL_RED, GL_FLOAT, simulation.getTrail().data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+            dirty = false;
+        }
+
+        return texture;
+    }
+
+    CpuSimulation& getSimulation() { return simulation; }
+private:
+    void addPass(const char* name, const passTimer& timer)
+    {
+        if (timer.last > timer.first)
+            profiler->addCpuRange(name, timer.first, timer.last);
+    }
+
+    void allocateTexture()
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, simulation.getWidth(), simulation.getHeight(), 0, GL_RED, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif
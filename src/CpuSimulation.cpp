@@ -0,0 +1,647 @@
+#include "CpuSimulation.hpp"
+#include "Hash.hpp"
+#include "Random.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    // Agents per call to the vectorised kernel, which is the size of its deposit scratch
+    const size_t AGENT_GRAIN = 4096;
+    const size_t AGENT_TASK = 1 << 15;
+    // Deposits are batched by bands of this many rows, so merging a band only touches
+    // a few hundred kilobytes of the trail map
+    const unsigned int DEPOSIT_BAND = 32;
+    // Agents per radix sort chunk. Chunks are a fixed size so the sort does not depend on the thread count.
+    const size_t SORT_CHUNK = 1 << 16;
+    const int RADIX_BITS = 8;
+    const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Moves field[order[i]] to field[i]
+    template <typename T>
+    void permute(ThreadPool& pool, std::vector<T>& field, std::vector<T>& scratch, const std::vector<uint32_t>& order)
+    {
+        // The two swap, so scratch keeps any spare capacity the field was given
+        scratch.reserve(field.capacity());
+        scratch.resize(field.size());
+        pool.parallelFor(field.size(), SORT_CHUNK, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                scratch[i] = field[order[i]];
+        });
+        field.swap(scratch);
+    }
+
+    // Number of pixels of [position - radius, position + radius] inside [0, size)
+    int windowCount(int position, int radius, int size)
+    {
+        return std::min(position + radius, size - 1) - std::max(position - radius, 0) + 1;
+    }
+}
+
+CpuSimulation::CpuSimulation(ThreadPool& pool, unsigned int width, unsigned int height)
+    : pool(pool)
+{
+    unsigned int threads = pool.getThreadCount();
+    deposits.resize(threads);
+    agentTimer.threads.resize(threads);
+    depositTimer.threads.resize(threads);
+    diffuseTimer.threads.resize(threads);
+    // The sort is timed as a whole from the thread that runs it
+    sortTimer.threads.resize(1);
+
+    kernelDeposits.resize(threads);
+    blurRows.resize(threads);
+    columnSums.resize(threads);
+    for (auto& scratch : kernelDeposits)
+        scratch.resize(AGENT_GRAIN);
+
+    trailResource = graph.addResource();
+    outputResource = graph.addResource();
+    agentResource = graph.addResource();
+    depositResource = graph.addResource();
+
+    setAgentKernel(agentKernelType::AUTO);
+    setDiffuseTileSize(DEFAULT_DIFFUSE_TILE_WIDTH, DEFAULT_DIFFUSE_TILE_HEIGHT);
+    resize(width, height);
+}
+
+void CpuSimulation::resize(unsigned int width, unsigned int height)
+{
+    this->width = width;
+    this->height = height;
+
+    // Assigning rather than resizing releases the old maps first when they were larger
+    trail.assign((size_t)width * height, 0.0f);
+    output.assign((size_t)width * height, 0.0f);
+    trail.shrink_to_fit();
+    output.shrink_to_fit();
+
+    for (auto& buckets : deposits)
+        buckets.assign((height + DEPOSIT_BAND - 1) / DEPOSIT_BAND, std::vector<uint32_t>());
+
+    agents.resize(0);
+    agents.setPrecision(precision, width, height);
+    stepCount = 0;
+}
+
+void CpuSimulation::setAgents(const AgentStore& agents)
+{
+    this->agents = agents;
+    this->agents.setPrecision(precision, width, height);
+    stepCount = 0;
+
+    reserveDeposits();
+}
+
+void CpuSimulation::spawnAgents(const SpawnSettings& settings, size_t count)
+{
+    agents.resize(0);
+    agents.setPrecision(precision, width, height);
+    agents.resize(count);
+    ::spawnAgents(pool, settings, agents, 0, count);
+    stepCount = 0;
+
+    reserveDeposits();
+}
+
+void CpuSimulation::setAgentCount(const SpawnSettings& settings, size_t count)
+{
+    size_t oldCount = agents.size();
+    if (count > oldCount)
+    {
+        agents.reserve(getGrownAgentCapacity(agents.capacity(), count));
+
+        agents.resize(count);
+        ::spawnAgents(pool, settings, agents, oldCount, count);
+        reserveDeposits();
+    }
+    else if (count < oldCount)
+    {
+        getAgentRemovalMoves(oldCount, count, removalMoves);
+        for (const auto& move : removalMoves)
+            agents.move(move.first, move.second);
+        agents.resize(count);
+    }
+}
+
+// Room for twice the average number of deposits per bucket, so they rarely grow while stepping
+void CpuSimulation::reserveDeposits()
+{
+    size_t perBucket = agents.size() / (deposits.size() * deposits[0].size()) + 1;
+    for (auto& buckets : deposits)
+    {
+        for (auto& bucket : buckets)
+        {
+            bucket.clear();
+            bucket.reserve(perBucket * 2);
+        }
+    }
+}
+
+void CpuSimulation::setAgentPrecision(agentPrecision precision)
+{
+    this->precision = precision;
+    agents.setPrecision(precision, width, height);
+}
+
+void CpuSimulation::setAgentKernel(agentKernelType type)
+{
+    kernelType = type;
+    kernel = ::getAgentKernel(type);
+}
+
+agentKernelType CpuSimulation::getAgentKernel() const
+{
+    if (!kernel || precision != agentPrecision::FLOAT32)
+        return agentKernelType::SCALAR;
+    if (kernel == getAgentKernelAvx512())
+        return agentKernelType::AVX512;
+    return agentKernelType::AVX2;
+}
+
+void CpuSimulation::clearTrail()
+{
+    std::fill(trail.begin(), trail.end(), 0.0f);
+    std::fill(output.begin(), output.end(), 0.0f);
+}
+
+void CpuSimulation::setDiffuseTileSize(unsigned int tileWidth, unsigned int tileHeight)
+{
+    diffuseTile = glm::uvec2(std::max(1u, tileWidth), std::max(1u, tileHeight));
+}
+
+// Agents, deposits and the diffuse are each split into tasks that declare the rows
+// or agents they touch, and the task graph orders them from that. Nothing waits
+// for a whole stage to finish: a block of the diffuse starts as soon as the
+// deposit bands it reads have been applied.
+void CpuSimulation::step(const SimulationSettings& settings, float deltaTime)
+{
+    if (settings.sortInterval > 0 && stepCount % settings.sortInterval == 0)
+        sortAgents();
+
+    agentTimer.begin();
+    depositTimer.begin();
+    diffuseTimer.begin();
+
+    graph.clear();
+    addAgentTasks(settings, deltaTime);
+    addDepositTasks(settings);
+    addDiffuseTasks(settings, deltaTime);
+    graph.run(pool);
+
+    agentTimer.end();
+    depositTimer.end();
+    diffuseTimer.end();
+
+    trail.swap(output);
+
+    stepCount++;
+}
+
+// Assumes every access reaches memory once: the agent is loaded and stored, three
+// sensor samples are read, and a deposit index is written, read back and applied
+double CpuSimulation::getBytesPerAgentStep() const
+{
+    return 2.0 * agents.getBytesPerAgent() + 3 * sizeof(float) + 2 * sizeof(uint32_t) + sizeof(float);
+}
+
+uint64_t CpuSimulation::getChecksum() const
+{
+    uint64_t hash = HASH_OFFSET_BASIS;
+    hash = hashBytes(hash, agents.x.data(), agents.x.size() * sizeof(float));
+    hash = hashBytes(hash, agents.y.data(), agents.y.size() * sizeof(float));
+    hash = hashBytes(hash, agents.position.data(), agents.position.size() * sizeof(uint32_t));
+    hash = hashBytes(hash, agents.angle.data(), agents.angle.size() * sizeof(float));
+    hash = hashBytes(hash, trail.data(), trail.size() * sizeof(float));
+    return hash;
+}
+
+// Reorders the agents by the Morton key of the tile they are in, with a stable least
+// significant digit radix sort over only the bits the trail size needs. Each pass
+// counts the digits of every chunk, turns the counts into where each chunk's agents
+// of each digit start, then moves them there. Agents keep their relative order within
+// a tile, so the result is the same for any thread count.
+void CpuSimulation::sortAgents()
+{
+    int64_t start = now();
+
+    const size_t count = agents.size();
+    const uint32_t tilesX = (width + AGENT_SORT_TILE - 1) / AGENT_SORT_TILE;
+    const uint32_t tilesY = (height + AGENT_SORT_TILE - 1) / AGENT_SORT_TILE;
+
+    int keyBits = 0;
+    while ((mortonKey(tilesX - 1, tilesY - 1) >> keyBits) != 0)
+        keyBits++;
+
+    // Nothing to sort, so no time is reported for it
+    if (count == 0 || keyBits == 0)
+    {
+        sortTimer.first = sortTimer.last = 0;
+        sortTimer.seconds = 0.0;
+        return;
+    }
+
+    sortTimer.begin();
+
+    sortKeys.resize(count);
+    sortKeysScratch.resize(count);
+    sortOrder.resize(count);
+    sortOrderScratch.resize(count);
+
+    pool.parallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            glm::vec2 pos = glm::max(agents.getPosition(i), glm::vec2(0.0f));
+            uint32_t tileX = std::min((uint32_t)pos.x / AGENT_SORT_TILE, tilesX - 1);
+            uint32_t tileY = std::min((uint32_t)pos.y / AGENT_SORT_TILE, tilesY - 1);
+
+            sortKeys[i] = mortonKey(tileX, tileY);
+            sortOrder[i] = (uint32_t)i;
+        }
+    });
+
+    const size_t chunks = (count + SORT_CHUNK - 1) / SORT_CHUNK;
+    for (int shift = 0; shift < keyBits; shift += RADIX_BITS)
+    {
+        sortHistograms.assign(chunks * RADIX_SIZE, 0);
+
+        pool.parallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, unsigned int)
+        {
+            uint32_t* histogram = &sortHistograms[begin / SORT_CHUNK * RADIX_SIZE];
+            for (size_t i = begin; i < end; i++)
+                histogram[(sortKeys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        });
+
+        // Every agent with a smaller digit goes first, then those with the same digit in earlier chunks
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_SIZE; digit++)
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                uint32_t& slot = sortHistograms[chunk * RADIX_SIZE + digit];
+                uint32_t digitCount = slot;
+                slot = offset;
+                offset += digitCount;
+            }
+        }
+
+        pool.parallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, unsigned int)
+        {
+            uint32_t* slots = &sortHistograms[begin / SORT_CHUNK * RADIX_SIZE];
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t slot = slots[(sortKeys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                sortKeysScratch[slot] = sortKeys[i];
+                sortOrderScratch[slot] = sortOrder[i];
+            }
+        });
+
+        sortKeys.swap(sortKeysScratch);
+        sortOrder.swap(sortOrderScratch);
+    }
+
+    if (precision == agentPrecision::FIXED16)
+    {
+        permute(pool, agents.position, sortKeysScratch, sortOrder);
+    }
+    else
+    {
+        permute(pool, agents.x, sortScratch, sortOrder);
+        permute(pool, agents.y, sortScratch, sortOrder);
+    }
+    permute(pool, agents.angle, sortScratch, sortOrder);
+
+    sortTimer.record(0, start, now());
+    sortTimer.end();
+}
+
+float CpuSimulation::load(int x, int y) const
+{
+    // imageLoad returns zero outside the image
+    if (x < 0 || y < 0 || x >= (int)width || y >= (int)height)
+        return 0.0f;
+
+    return trail[(size_t)y * width + x];
+}
+
+void CpuSimulation::addAgentTasks(const SimulationSettings& settings, float deltaTime)
+{
+    if (kernel && precision == agentPrecision::FLOAT32)
+    {
+        const float sensorRadians = glm::radians(settings.sensorAngle);
+
+        kernelParams.x = agents.x.data();
+        kernelParams.y = agents.y.data();
+        kernelParams.angle = agents.angle.data();
+        kernelParams.trail = trail.data();
+        kernelParams.width = width;
+        kernelParams.height = height;
+        kernelParams.movementDistance = settings.movementDistance;
+        kernelParams.deltaTime = deltaTime;
+        kernelParams.sensorDistance = settings.sensorDistance;
+        kernelParams.sensorCos = std::cos(sensorRadians);
+        kernelParams.sensorSin = std::sin(sensorRadians);
+        kernelParams.rotationAngle = settings.rotationAngle;
+        kernelParams.key = settings.seed ^ RANDOM_STREAM_AGENT;
+        kernelParams.step = stepCount;
+    }
+
+    for (size_t begin = 0; begin < agents.size(); begin += AGENT_TASK)
+    {
+        size_t end = std::min(begin + AGENT_TASK, agents.size());
+
+        std::vector<resourceAccess> accesses = {
+            cpuAccess(trailResource, accessMode::READ),
+            cpuAccess(agentResource, accessMode::READ_WRITE, begin, end),
+            cpuAccess(depositResource, accessMode::ACCUMULATE)
+        };
+
+        graph.addTask(accesses, [this, &settings, deltaTime, begin, end](unsigned int thread)
+        {
+            int64_t start = now();
+
+            if (precision == agentPrecision::FIXED16)
+                updateAgents<true>(settings, deltaTime, begin, end, thread);
+            else if (kernel)
+                updateAgentsVectorised(begin, end, thread);
+            else
+                updateAgents<false>(settings, deltaTime, begin, end, thread);
+
+            agentTimer.record(thread, start, now());
+        });
+    }
+}
+
+// Mirrors agentComputeShader.glsl. Sensors read the trail as it was before this
+// step, and deposits are applied afterwards, so the result does not depend on
+// how the agents were split between threads.
+template <bool FixedPositions>
+void CpuSimulation::updateAgents(const SimulationSettings& settings, float deltaTime, size_t begin, size_t end, unsigned int thread)
+{
+    const glm::vec2 size((float)width, (float)height);
+    const uint32_t key = settings.seed ^ RANDOM_STREAM_AGENT;
+
+    std::vector<std::vector<uint32_t>>& buckets = deposits[thread];
+
+    for (size_t i = begin; i < end; i++)
+    {
+        glm::vec2 pos = FixedPositions ? agents.unpack(agents.position[i]) : glm::vec2(agents.x[i], agents.y[i]);
+        float angle = agents.angle[i];
+        float newAngle = angle;
+
+        // Movement Stage
+        float radians = glm::radians(angle);
+        glm::vec2 newPos;
+        newPos.x = pos.x + (settings.movementDistance * std::cos(radians) * deltaTime);
+        newPos.y = pos.y + (settings.movementDistance * std::sin(radians) * deltaTime);
+
+        philox2x32 bits = philox((uint32_t)i, stepCount, key);
+        float rnd = uniformFloat(bits.x);
+
+        if (newPos.x >= size.x || newPos.x <= 0 || newPos.y >= size.y || newPos.y <= 0)
+        {
+            newPos = glm::clamp(newPos, glm::vec2(0.0f), size - 1.0f);
+            newAngle = 180 + (rnd * 30.0f - 15.0f);
+        }
+
+        if (FixedPositions)
+        {
+            agents.position[i] = agents.pack(newPos);
+        }
+        else
+        {
+            agents.x[i] = newPos.x;
+            agents.y[i] = newPos.y;
+        }
+
+        int depositX = (int)pos.x;
+        int depositY = (int)pos.y;
+        if (depositX >= 0 && depositY >= 0 && depositX < (int)width && depositY < (int)height)
+            buckets[depositY / DEPOSIT_BAND].push_back((uint32_t)depositY * width + depositX);
+
+        // Sensory Stage
+        float front = load(
+            (int)(pos.x + settings.sensorDistance * std::cos(radians)),
+            (int)(pos.y + settings.sensorDistance * std::sin(radians)));
+
+        float leftRadians = glm::radians(angle - settings.sensorAngle);
+        float frontLeft = load(
+            (int)(pos.x + settings.sensorDistance * std::cos(leftRadians)),
+            (int)(pos.y + settings.sensorDistance * std::sin(leftRadians)));
+
+        float rightRadians = glm::radians(angle + settings.sensorAngle);
+        float frontRight = load(
+            (int)(pos.x + settings.sensorDistance * std::cos(rightRadians)),
+            (int)(pos.y + settings.sensorDistance * std::sin(rightRadians)));
+
+        if (front < frontLeft && front < frontRight) // Rotate Randomly
+        {
+            float r = uniformFloat(bits.y);
+            if (r < 0.5f) // Rotate Left
+                newAngle -= settings.rotationAngle * rnd;
+            else // Rotate Right
+                newAngle += settings.rotationAngle * rnd;
+        }
+        else if (frontLeft > frontRight) // Rotate Left
+        {
+            newAngle -= settings.rotationAngle * rnd;
+        }
+        else if (frontRight > frontLeft) // Rotate Right
+        {
+            newAngle += settings.rotationAngle * rnd;
+        }
+
+        agents.angle[i] = newAngle;
+    }
+}
+
+void CpuSimulation::updateAgentsVectorised(size_t begin, size_t end, unsigned int thread)
+{
+    const uint32_t bandPixels = width * DEPOSIT_BAND;
+
+    std::vector<std::vector<uint32_t>>& buckets = deposits[thread];
+    int32_t* pixels = kernelDeposits[thread].data();
+
+    for (size_t chunk = begin; chunk < end; chunk += AGENT_GRAIN)
+    {
+        size_t chunkEnd = std::min(chunk + AGENT_GRAIN, end);
+        kernel(kernelParams, chunk, chunkEnd, pixels);
+
+        for (size_t i = 0; i < chunkEnd - chunk; i++)
+        {
+            if (pixels[i] >= 0)
+                buckets[(uint32_t)pixels[i] / bandPixels].push_back((uint32_t)pixels[i]);
+        }
+    }
+}
+
+// Each band of rows is owned by one task, so no two threads write the same pixel.
+// Every deposit adds the same amount, so accumulating gives the same result whichever
+// order the buckets are merged in.
+void CpuSimulation::addDepositTasks(const SimulationSettings& settings)
+{
+    const unsigned int bands = deposits[0].size();
+
+    for (unsigned int band = 0; band < bands; band++)
+    {
+        size_t rowBegin = band * DEPOSIT_BAND;
+        size_t rowEnd = std::min(rowBegin + DEPOSIT_BAND, (size_t)height);
+
+        std::vector<resourceAccess> accesses = {
+            cpuAccess(depositResource, accessMode::READ_WRITE, rowBegin, rowEnd),
+            cpuAccess(trailResource, accessMode::READ_WRITE, rowBegin, rowEnd)
+        };
+
+        graph.addTask(accesses, [this, &settings, band](unsigned int thread)
+        {
+            int64_t start = now();
+            const bool accumulate = settings.deposit == depositMode::ACCUMULATE;
+            const float amount = settings.depositAmount;
+
+            for (auto& buckets : deposits)
+            {
+                if (accumulate)
+                {
+                    for (uint32_t index : buckets[band])
+                        trail[index] += amount;
+                }
+                else
+                {
+                    for (uint32_t index : buckets[band])
+                        trail[index] = amount;
+                }
+
+                buckets[band].clear();
+            }
+
+            depositTimer.record(thread, start, now());
+        });
+    }
+}
+
+void CpuSimulation::addDiffuseTasks(const SimulationSettings& settings, float deltaTime)
+{
+    const int radius = glm::clamp(settings.diffuseRadius, 0, MAX_DIFFUSE_RADIUS);
+    const glm::uvec2 tileSize = glm::min(diffuseTile, glm::uvec2(width, height));
+
+    for (auto& rows : blurRows)
+        rows.resize((size_t)(2 * radius + 1) * tileSize.x);
+    for (auto& sums : columnSums)
+        sums.resize(tileSize.x);
+
+    const size_t columns = (width + tileSize.x - 1) / tileSize.x;
+
+    for (size_t top = 0; top < height; top += tileSize.y)
+    {
+        size_t bottom = std::min(top + tileSize.y, (size_t)height);
+
+        for (size_t left = 0; left < width; left += tileSize.x)
+        {
+            size_t right = std::min(left + tileSize.x, (size_t)width);
+            // Output is declared in tiles rather than rows, so tiles side by side do not wait for each other
+            size_t tile = top / tileSize.y * columns + left / tileSize.x;
+
+            std::vector<resourceAccess> accesses = {
+                cpuAccess(trailResource, accessMode::READ, top - std::min(top, (size_t)radius), std::min(bottom + radius, (size_t)height)),
+                cpuAccess(outputResource, accessMode::WRITE, tile, tile + 1)
+            };
+
+            graph.addTask(accesses, [this, &settings, deltaTime, left, right, top, bottom](unsigned int thread)
+            {
+                int64_t start = now();
+                diffuseDecay(settings, deltaTime, left, right, top, bottom, thread);
+                diffuseTimer.record(thread, start, now());
+            });
+        }
+    }
+}
+
+// Same result as diffuseBlurCompute.glsl followed by diffuseDecayCompute.glsl, for the
+// tile [left, right) x [top, bottom). The tile keeps a ring of its 2 * radius + 1
+// horizontally blurred rows and a running sum of every column over them, so the work
+// per pixel does not depend on the radius. The blur reads a halo of radius pixels on
+// each side of the tile from the trail, which is never written during the diffuse,
+// so tiles need no exchange between them. Tiles are a fixed size, so the result does
+// not depend on the thread count.
+void CpuSimulation::diffuseDecay(const SimulationSettings& settings, float deltaTime, size_t left, size_t right, size_t top, size_t bottom, unsigned int thread)
+{
+    const int radius = glm::clamp(settings.diffuseRadius, 0, MAX_DIFFUSE_RADIUS);
+    const int ringRows = 2 * radius + 1;
+    const float decay = settings.decayAmount * deltaTime;
+    const int w = width;
+    const int h = height;
+    const int x0 = (int)left;
+    const int x1 = (int)right;
+    const int tileWidth = x1 - x0;
+
+    float* ring = blurRows[thread].data();
+    float* sums = columnSums[thread].data();
+
+    // Horizontal running sum along row y, into its slot in the ring
+    auto blurRow = [&](int y)
+    {
+        const float* source = &trail[(size_t)y * width];
+        float* blurred = ring + (size_t)(y % ringRows) * tileWidth;
+
+        float sum = 0.0f;
+        for (int x = std::max(x0 - radius, 0); x < std::min(x0 + radius, w); x++)
+            sum += source[x];
+
+        for (int x = x0; x < x1; x++)
+        {
+            if (x + radius < w)
+                sum += source[x + radius];
+
+            blurred[x - x0] = sum / (float)windowCount(x, radius, w);
+
+            if (x - radius >= 0)
+                sum -= source[x - radius];
+        }
+    };
+
+    auto addRow = [&](int y, float sign)
+    {
+        const float* blurred = ring + (size_t)(y % ringRows) * tileWidth;
+        for (int x = 0; x < tileWidth; x++)
+            sums[x] += sign * blurred[x];
+    };
+
+    std::fill(sums, sums + tileWidth, 0.0f);
+    for (int y = std::max((int)top - radius, 0); y < std::min((int)top + radius, h); y++)
+    {
+        blurRow(y);
+        addRow(y, 1.0f);
+    }
+
+    for (int y = (int)top; y < (int)bottom; y++)
+    {
+        if (y + radius < h)
+        {
+            blurRow(y + radius);
+            addRow(y + radius, 1.0f);
+        }
+
+        const float count = (float)windowCount(y, radius, h);
+        const float* original = &trail[(size_t)y * width + x0];
+        float* target = &output[(size_t)y * width + x0];
+        for (int x = 0; x < tileWidth; x++)
+        {
+            // Diffuse
+            float strength = glm::mix(original[x], sums[x] / count, settings.diffuseSpeed);
+
+            target[x] = std::max(0.0f, strength - decay);
+        }
+
+        if (y - radius >= 0)
+            addRow(y - radius, -1.0f);
+    }
+}
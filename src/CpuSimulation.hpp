@@ -0,0 +1,177 @@
+#ifndef CPU_SIMULATION_HPP
+#define CPU_SIMULATION_HPP
+
+#include <GLM/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "AgentKernel.hpp"
+#include "AgentSpawner.hpp"
+#include "AgentStore.hpp"
+#include "FrameGraph.hpp"
+#include "SimulationBackend.hpp"
+#include "ThreadPool.hpp"
+
+// Wall time of one pass of a step, from the first of its tasks starting on any thread
+// to the last one finishing. Tasks of other passes may have run in between.
+struct passTimer
+{
+    // First start and last end of the pass's tasks on each thread, in nanoseconds
+    std::vector<std::pair<int64_t, int64_t>> threads;
+    // Start and end of the whole pass, on the steady_clock
+    int64_t first = 0, last = 0;
+    double seconds = 0.0;
+
+    void begin()
+    {
+        for (auto& times : threads)
+            times = std::make_pair(INT64_MAX, INT64_MIN);
+    }
+
+    void record(unsigned int thread, int64_t start, int64_t end)
+    {
+        std::pair<int64_t, int64_t>& times = threads[thread];
+        times.first = std::min(times.first, start);
+        times.second = std::max(times.second, end);
+    }
+
+    void end()
+    {
+        first = INT64_MAX;
+        last = INT64_MIN;
+        for (const auto& times : threads)
+        {
+            first = std::min(first, times.first);
+            last = std::max(last, times.second);
+        }
+        if (last <= first)
+            first = last = 0;
+        seconds = (last - first) * 1e-9;
+    }
+};
+
+// Host implementation of the agent and diffuse/decay compute shaders.
+// Does not touch OpenGL, so it can run on machines without a GPU.
+class CpuSimulation
+{
+public:
+    // A tile of this size, the rows around it it reads and the output it writes take
+    // about 1 MB, which fits in the L2 of a current desktop core. Narrower tiles were
+    // slower on a 4K trail map as long as the rows still fitted.
+    static const unsigned int DEFAULT_DIFFUSE_TILE_WIDTH = 4096;
+    static const unsigned int DEFAULT_DIFFUSE_TILE_HEIGHT = 32;
+private:
+    unsigned int width, height;
+
+    ThreadPool& pool;
+
+    AgentStore agents;
+    agentPrecision precision = agentPrecision::FLOAT32;
+    uint32_t stepCount = 0;
+
+    agentKernelType kernelType = agentKernelType::AUTO;
+    AgentKernel kernel = nullptr;
+    AgentKernelParams kernelParams;
+    std::vector<std::vector<int32_t>> kernelDeposits;
+    // Trail strength, one float per pixel. diffuseDecay writes every pixel of output
+    // from trail, then the two swap.
+    std::vector<float> trail;
+    std::vector<float> output;
+
+    // Pixel indices written by each thread, bucketed by the row band they land in
+    std::vector<std::vector<std::vector<uint32_t>>> deposits;
+
+    passTimer agentTimer, depositTimer, diffuseTimer;
+
+    // Radix sort keys and the agent order being sorted, double buffered, and the
+    // digit counts of each chunk. sortScratch holds a field while it is permuted.
+    std::vector<uint32_t> sortKeys, sortKeysScratch;
+    std::vector<uint32_t> sortOrder, sortOrderScratch;
+    std::vector<uint32_t> sortHistograms;
+    std::vector<float> sortScratch;
+    passTimer sortTimer;
+
+    std::vector<std::pair<uint32_t, uint32_t>> removalMoves;
+
+    // Size of the blocks the diffuse is split into, see diffuseDecay
+    glm::uvec2 diffuseTile;
+    // Per thread ring of horizontally blurred tile rows and their running column sums
+    std::vector<std::vector<float>> blurRows;
+    std::vector<std::vector<float>> columnSums;
+
+    TaskGraph graph;
+    unsigned int trailResource, outputResource, agentResource, depositResource;
+public:
+    CpuSimulation(ThreadPool& pool, unsigned int width, unsigned int height);
+
+    // Reallocates the trail map at a new size, cleared, and removes every agent
+    void resize(unsigned int width, unsigned int height);
+
+    void setAgents(const AgentStore& agents);
+    // Replaces the agents with count from spawnAgents, generated in place
+    void spawnAgents(const SpawnSettings& settings, size_t count);
+    // Spawns or removes agents until there are count, see SimulationBackend::setAgentCount
+    void setAgentCount(const SpawnSettings& settings, size_t count);
+    void setAgentPrecision(agentPrecision precision);
+
+    // Vectorised kernels are only used with agentPrecision::FLOAT32
+    void setAgentKernel(agentKernelType type);
+    agentKernelType getAgentKernel() const;
+    void clearTrail();
+
+    // Smaller tiles spread over more threads and keep less in cache, but redo the blur
+    // of the rows above and below them. The result depends on the tile size. Tiles
+    // larger than the trail map are cut down to it.
+    void setDiffuseTileSize(unsigned int tileWidth, unsigned int tileHeight);
+    glm::uvec2 getDiffuseTileSize() const { return diffuseTile; }
+
+    void step(const SimulationSettings& settings, float deltaTime);
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+    unsigned int getThreadCount() const { return pool.getThreadCount(); }
+    uint32_t getStepCount() const { return stepCount; }
+
+    // Wall time of the agent pass in the last step, and its modelled memory traffic
+    double getAgentPassSeconds() const { return agentTimer.seconds; }
+    double getBytesPerAgentStep() const;
+
+    // Wall time of applying the deposits and of the diffuse in the last step. The task
+    // graph overlaps the passes, so they can add up to more than the whole step.
+    double getDepositPassSeconds() const { return depositTimer.seconds; }
+    double getDiffusePassSeconds() const { return diffuseTimer.seconds; }
+
+    // Wall time of the last agent sort, see SimulationSettings::sortInterval
+    double getSortSeconds() const { return sortTimer.seconds; }
+
+    // When each pass of the last step ran, and the last sort
+    const passTimer& getAgentPassTimer() const { return agentTimer; }
+    const passTimer& getDepositPassTimer() const { return depositTimer; }
+    const passTimer& getDiffusePassTimer() const { return diffuseTimer; }
+    const passTimer& getSortTimer() const { return sortTimer; }
+
+    // Hash of the agents and trail map, for checking that two runs are bit-identical
+    uint64_t getChecksum() const;
+
+    const AgentStore& getAgents() const { return agents; }
+    const std::vector<float>& getTrail() const { return trail; }
+private:
+    void reserveDeposits();
+    void sortAgents();
+
+    void addAgentTasks(const SimulationSettings& settings, float deltaTime);
+    void addDepositTasks(const SimulationSettings& settings);
+    void addDiffuseTasks(const SimulationSettings& settings, float deltaTime);
+
+    template <bool FixedPositions>
+    void updateAgents(const SimulationSettings& settings, float deltaTime, size_t begin, size_t end, unsigned int thread);
+    void updateAgentsVectorised(size_t begin, size_t end, unsigned int thread);
+    void diffuseDecay(const SimulationSettings& settings, float deltaTime, size_t left, size_t right, size_t top, size_t bottom, unsigned int thread);
+
+    float load(int x, int y) const;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef FRAME_GRAPH_HPP
+#define FRAME_GRAPH_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+// Passes declare which resources they read and write, and the ordering they need
+// is derived from that instead of being written out by hand. FrameGraph turns the
+// declarations into the memory barriers a GPU pass needs, TaskGraph turns them into
+// dependencies between CPU tasks. Neither touches OpenGL.
+
+enum class accessMode
+{
+    READ,
+    WRITE,
+    READ_WRITE,
+    // Writes that can happen in any order, such as adding to per-thread buckets.
+    // They do not depend on each other, only on reads and plain writes.
+    ACCUMULATE
+};
+
+// How a GPU pass touches a resource, which decides the barrier bit it needs after a
+// shader has written the resource. Values are bits so they can be combined.
+enum class resourceUse : unsigned int
+{
+    IMAGE = 1 << 0,
+    STORAGE_BUFFER = 1 << 1,
+    TEXTURE_FETCH = 1 << 2,
+    FRAMEBUFFER = 1 << 3,
+    TEXTURE_UPDATE = 1 << 4,
+    BUFFER_UPDATE = 1 << 5
+};
+
+struct resourceAccess
+{
+    unsigned int resource;
+    accessMode mode;
+    resourceUse use;
+
+    // Part of the resource touched, in whatever unit it is divided into (rows, agents)
+    size_t begin;
+    size_t end;
+};
+
+inline resourceAccess gpuAccess(unsigned int resource, accessMode mode, resourceUse use)
+{
+    return { resource, mode, use, 0, SIZE_MAX };
+}
+
+inline resourceAccess cpuAccess(unsigned int resource, accessMode mode, size_t begin = 0, size_t end = SIZE_MAX)
+{
+    return { resource, mode, resourceUse::IMAGE, begin, end };
+}
+
+inline bool writes(accessMode mode)
+{
+    return mode != accessMode::READ;
+}
+
+// Whether b has to wait for a, when a was declared first
+inline bool conflicts(const resourceAccess& a, const resourceAccess& b)
+{
+    if (a.resource != b.resource || a.end <= b.begin || b.end <= a.begin)
+        return false;
+    if (a.mode == accessMode::ACCUMULATE && b.mode == accessMode::ACCUMULATE)
+        return false;
+    return writes(a.mode) || writes(b.mode);
+}
+
+// Tracks which resources shaders have written since the last barrier covering each use
+class FrameGraph
+{
+private:
+    struct resourceState
+    {
+        bool dirty = false;
+        // Uses that have had a barrier since the last shader write
+        unsigned int synced = 0;
+    };
+
+    std::vector<resourceState> resources;
+public:
+    unsigned int addResource()
+    {
+        resources.emplace_back();
+        return resources.size() - 1;
+    }
+
+    // Returns the uses that need a barrier before a pass with these accesses can run,
+    // as resourceUse bits, and records the pass's own shader writes
+    unsigned int pass(const std::vector<resourceAccess>& accesses)
+    {
+        unsigned int barrier = 0;
+        for (const resourceAccess& access : accesses)
+        {
+            const resourceState& state = resources[access.resource];
+            if (state.dirty && !(state.synced & (unsigned int)access.use))
+                barrier |= (unsigned int)access.use;
+        }
+
+        // A barrier covers every outstanding write, not just the ones this pass touches
+        if (barrier)
+        {
+            for (resourceState& state : resources)
+                state.synced |= barrier;
+        }
+
+        for (const resourceAccess& access : accesses)
+        {
+            // Only image and storage buffer stores are incoherent
+            bool shaderWrite = access.use == resourceUse::IMAGE || access.use == resourceUse::STORAGE_BUFFER;
+            if (writes(access.mode) && shaderWrite)
+            {
+                resources[access.resource].dirty = true;
+                resources[access.resource].synced = 0;
+            }
+        }
+
+        return barrier;
+    }
+
+    // After glFinish, or when every resource has been rewritten by the client
+    void clear()
+    {
+        for (resourceState& state : resources)
+            state = resourceState();
+    }
+};
+
+// Runs tasks on a ThreadPool, each as soon as the tasks it conflicts with have finished.
+// Tasks are given the index of the thread running them and must not call parallelFor.
+class TaskGraph
+{
+public:
+    typedef std::function<void(unsigned int)> Task;
+private:
+    struct node
+    {
+        Task task;
+        std::vector<resourceAccess> accesses;
+        std::vector<unsigned int> dependents;
+        unsigned int dependencies = 0;
+        unsigned int waiting = 0;
+    };
+
+    std::vector<node> nodes;
+    // Accesses declared so far for each resource, with the task that made them
+    std::vector<std::vector<std::pair<unsigned int, resourceAccess>>> history;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<unsigned int> queue;
+    size_t remaining = 0;
+public:
+    unsigned int addResource()
+    {
+        history.emplace_back();
+        return history.size() - 1;
+    }
+
+    // Makes the task depend on every earlier task with a conflicting access
+    unsigned int addTask(const std::vector<resourceAccess>& accesses, Task task)
+    {
+        unsigned int id = nodes.size();
+        nodes.emplace_back();
+        nodes[id].task = std::move(task);
+        nodes[id].accesses = accesses;
+
+        for (const resourceAccess& access : accesses)
+        {
+            for (const auto& earlier : history[access.resource])
+            {
+                node& before = nodes[earlier.first];
+                if (earlier.first == id || !conflicts(earlier.second, access))
+                    continue;
+                if (!before.dependents.empty() && before.dependents.back() == id)
+                    continue;
+
+                before.dependents.push_back(id);
+                nodes[id].dependencies++;
+            }
+        }
+
+        for (const resourceAccess& access : accesses)
+            history[access.resource].emplace_back(id, access);
+
+        return id;
+    }
+
+    size_t getTaskCount() const { return nodes.size(); }
+
+    // Removes every task, keeping the resources
+    void clear()
+    {
+        nodes.clear();
+        for (auto& accesses : history)
+            accesses.clear();
+    }
+
+    void run(ThreadPool& pool)
+    {
+        if (nodes.empty())
+            return;
+
+        queue.clear();
+        for (unsigned int i = 0; i < nodes.size(); i++)
+        {
+            nodes[i].waiting = nodes[i].dependencies;
+            if (nodes[i].waiting == 0)
+                queue.push_back(i);
+        }
+        remaining = nodes.size();
+
+        // Every thread takes tasks off the ready queue until the whole graph has run
+        pool.parallelFor(pool.getThreadCount(), 1, [&](size_t, size_t, unsigned int thread)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                ready.wait(lock, [&]() { return !queue.empty() || remaining == 0; });
+                if (remaining == 0)
+                    return;
+
+                unsigned int id = queue.back();
+                queue.pop_back();
+
+                lock.unlock();
+                nodes[id].task(thread);
+                lock.lock();
+
+                unsigned int released = 0;
+                for (unsigned int dependent : nodes[id].dependents)
+                {
+                    if (--nodes[dependent].waiting == 0)
+                    {
+                        queue.push_back(dependent);
+                        released++;
+                    }
+                }
+
+                if (--remaining == 0)
+                    ready.notify_all();
+                else if (released > 1)
+                    ready.notify_all();
+                else if (released == 1)
+                    ready.notify_one();
+            }
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,752 @@
+#ifndef GPU_BACKEND_HPP
+#define GPU_BACKEND_HPP
+
+#include <GLAD/glad.h>
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AgentBuffers.hpp"
+#include "FrameGraph.hpp"
+#include "Profiler.hpp"
+#include "Shader.hpp"
+#include "ShaderCompiler.hpp"
+#include "SimulationBackend.hpp"
+
+// Runs the simulation with the OpenGL 4.3 compute shaders
+class GpuBackend : public SimulationBackend
+{
+public:
+    static const unsigned int DEFAULT_AGENT_GROUP_SIZE = 64;
+    // Must match agentSortCompute.glsl
+    static const unsigned int SORT_GROUP_SIZE = 256;
+    static const unsigned int SORT_CHUNK = 4096;
+    // Sorted a byte of the key at a time, one sort invocation per digit
+    static const int RADIX_BITS = 8;
+    static const unsigned int RADIX_SIZE = 1u << RADIX_BITS;
+    // Must match agentRemoveCompute.glsl
+    static const unsigned int REMOVE_GROUP_SIZE = 64;
+    // Diffuse radii up to this get a variant that adds up the window directly instead of scanning
+    static const int MAX_UNROLLED_DIFFUSE_RADIUS = 4;
+private:
+    unsigned int width, height;
+    // Single channel trail strength, coloured when drawn. Each step reads trails[current]
+    // as image 0 and writes the other as image 1, then the two swap.
+    unsigned int trails[2];
+    unsigned int current = 0;
+    // Horizontally blurred trail, between the two diffuse passes
+    unsigned int blurTexture;
+    // Deposits counted this step in depositMode::ACCUMULATE, added to the trail by the diffuse passes
+    unsigned int depositTexture;
+    unsigned int fbo;
+    int agentCount = 0;
+    unsigned int agentGroupSize = DEFAULT_AGENT_GROUP_SIZE;
+    int maxGroupCount = 65535;
+    int maxGroupSize = 1024;
+    unsigned int stepCount = 0;
+
+    // Agent x, y and angle, each in its own storage buffer, and the spare set sorting moves them to
+    AgentBuffers agentBuffers;
+    // Agents with each digit in each chunk, then where they start, see sortAgents
+    unsigned int digitOffsetBuffer;
+    size_t digitOffsetCapacity = 0;
+    // std140 layout of simulationParams.glsl, every member 4 bytes
+    struct simulationParams
+    {
+        int32_t agentCount;
+        uint32_t stepIndex;
+        uint32_t seed;
+        float deltaTime;
+
+        float movementDistance;
+        float sensorDistance;
+        float sensorAngle;
+        float rotationAngle;
+
+        uint32_t accumulateDeposits;
+        float depositAmount;
+        int32_t radius;
+        float decayAmount;
+
+        float diffuseSpeed;
+        // Some drivers round the block up to a whole vec4
+        float padding[3];
+    };
+    // Uniform buffer bound to binding 0, holding simulationParams
+    unsigned int paramsBuffer;
+
+    // Where agents past the new count move to when removing agents, see setAgentCount
+    unsigned int removalBuffer;
+    std::vector<std::pair<uint32_t, uint32_t>> removalMoves;
+
+    // Compiled for the settings in use, see getAgentDefines and getDiffuseDefines
+    ComputeShaderVariants agentShaders { "res/Shaders/agentComputeShader.glsl" };
+    ComputeShaderVariants diffuseBlurShaders { "res/Shaders/diffuseBlurCompute.glsl" };
+    ComputeShaderVariants diffuseDecayShaders { "res/Shaders/diffuseDecayCompute.glsl" };
+    ComputeShader sortCountShader;
+    ComputeShader sortScanShader;
+    ComputeShader sortScatterShader;
+    ComputeShader removeShader;
+    // Links the shaders while the constructor's caller carries on, see waitForShaders
+    ShaderCompiler* compiler;
+    bool shadersPending = false;
+
+    // Programs recompiled by reloadShaders, waiting to be swapped in between steps
+    struct reloadedShader
+    {
+        ComputeShader* shader;
+        ComputeShader replacement;
+    };
+    std::mutex reloadMutex;
+    std::vector<reloadedShader> reloadedShaders;
+
+    // Works out the barrier each pass needs from what it reads and writes
+    FrameGraph graph;
+    unsigned int trailResources[2];
+    unsigned int blurResource, depositResource, agentResource;
+    unsigned int sortedResource, digitOffsetResource, removalResource;
+public:
+    // With a compiler the shaders are compiled on its context, and the first call that
+    // needs them waits for them. The compiler has to outlive the backend.
+    GpuBackend(unsigned int width, unsigned int height, ShaderCompiler* compiler = nullptr)
+        : width(width), height(height), compiler(compiler)
+    {
+        generateTexture(trails[0], GL_LINEAR);
+        generateTexture(trails[1], GL_LINEAR);
+        generateTexture(blurTexture, GL_LINEAR);
+        generateTexture(depositTexture, GL_NEAREST);
+
+        glGenFramebuffers(1, &fbo);
+        glGenBuffers(1, &digitOffsetBuffer);
+        glGenBuffers(1, &removalBuffer);
+
+        glGenBuffers(1, &paramsBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(simulationParams), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsBuffer);
+
+        allocateTrail();
+
+        trailResources[0] = graph.addResource();
+        trailResources[1] = graph.addResource();
+        blurResource = graph.addResource();
+        depositResource = graph.addResource();
+        agentResource = graph.addResource();
+        sortedResource = graph.addResource();
+        digitOffsetResource = graph.addResource();
+        removalResource = graph.addResource();
+
+        glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroupCount);
+        glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxGroupSize);
+        int maxInvocations;
+        glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+        maxGroupSize = std::min(maxGroupSize, maxInvocations);
+
+        auto compileShaders = [this]()
+        {
+            sortCountShader.compileFromPath("res/Shaders/agentSortCompute.glsl");
+            sortScanShader.compileFromPath("res/Shaders/agentSortScanCompute.glsl");
+            sortScatterShader.compileFromPath("res/Shaders/agentSortCompute.glsl", "#define SCATTER");
+            removeShader.compileFromPath("res/Shaders/agentRemoveCompute.glsl");
+        };
+
+        if (compiler)
+        {
+            compiler->submit(compileShaders);
+            shadersPending = true;
+        }
+        else
+        {
+            compileShaders();
+        }
+    }
+
+    ~GpuBackend()
+    {
+        waitForShaders();
+        finishReloads();
+
+        agentShaders.clear();
+        diffuseBlurShaders.clear();
+        diffuseDecayShaders.clear();
+        glDeleteProgram(sortCountShader.ID);
+        glDeleteProgram(sortScanShader.ID);
+        glDeleteProgram(sortScatterShader.ID);
+        glDeleteProgram(removeShader.ID);
+
+        glDeleteBuffers(1, &paramsBuffer);
+        glDeleteBuffers(1, &removalBuffer);
+        glDeleteBuffers(1, &digitOffsetBuffer);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &depositTexture);
+        glDeleteTextures(1, &blurTexture);
+        glDeleteTextures(2, trails);
+    }
+
+    const char* getName() const override { return "GPU"; }
+
+    // Largest trail map the driver can allocate and run the diffuse passes over, which
+    // dispatch a workgroup per row and per column. Needs a current OpenGL context.
+    static glm::uvec2 getMaxTrailSize()
+    {
+        GLint maxTextureSize, maxColumns, maxRows;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxColumns);
+        glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &maxRows);
+        return glm::uvec2(std::min(maxTextureSize, maxColumns), std::min(maxTextureSize, maxRows));
+    }
+
+    void resize(unsigned int width, unsigned int height) override
+    {
+        beginPass({
+            gpuAccess(trailResources[0], accessMode::WRITE, resourceUse::TEXTURE_UPDATE),
+            gpuAccess(trailResources[1], accessMode::WRITE, resourceUse::TEXTURE_UPDATE),
+            gpuAccess(blurResource, accessMode::WRITE, resourceUse::TEXTURE_UPDATE),
+            gpuAccess(depositResource, accessMode::WRITE, resourceUse::TEXTURE_UPDATE)
+        });
+
+        this->width = width;
+        this->height = height;
+        agentCount = 0;
+        stepCount = 0;
+        current = 0;
+        allocateTrail();
+    }
+
+    void reset(const AgentStore& agents) override
+    {
+        // The shaders only read float positions
+        if (agents.getPrecision() != agentPrecision::FLOAT32)
+        {
+            AgentStore converted = agents;
+            converted.setPrecision(agentPrecision::FLOAT32, width, height);
+            reset(converted);
+            return;
+        }
+
+        beginAgentWrite(agents.size());
+
+        const std::vector<float>* fields[AgentBuffers::FIELDS] = { &agents.x, &agents.y, &agents.angle };
+        for (int i = 0; i < AgentBuffers::FIELDS; i++)
+            std::copy(fields[i]->begin(), fields[i]->end(), agentBuffers.getStaging(i));
+
+        agentBuffers.upload(0, agentCount);
+        clearTrail();
+    }
+
+    void spawn(ThreadPool& pool, const SpawnSettings& settings, size_t count) override
+    {
+        beginAgentWrite(count);
+
+        spawnAgents(pool, settings, agentBuffers.getStaging(0), agentBuffers.getStaging(1), agentBuffers.getStaging(2), 0, count);
+
+        agentBuffers.upload(0, agentCount);
+        clearTrail();
+    }
+
+    void setAgentCount(ThreadPool& pool, const SpawnSettings& settings, size_t count) override
+    {
+        size_t oldCount = agentCount;
+        if (count > oldCount)
+        {
+            // Growing copies the agents, and uploading overwrites the new ones
+            beginPass({ gpuAccess(agentResource, accessMode::READ_WRITE, resourceUse::BUFFER_UPDATE) });
+
+            if (count > agentBuffers.getCapacity())
+                agentBuffers.reserve(getGrownAgentCapacity(agentBuffers.getCapacity(), count), oldCount);
+            agentBuffers.waitForUploads();
+
+            spawnAgents(pool, settings, agentBuffers.getStaging(0), agentBuffers.getStaging(1), agentBuffers.getStaging(2), oldCount, count);
+            agentBuffers.upload(oldCount, count);
+            agentCount = count;
+        }
+        else if (count < oldCount)
+        {
+            getAgentRemovalMoves(oldCount, count, removalMoves);
+            agentCount = count;
+            if (removalMoves.empty())
+                return;
+
+            waitForShaders();
+
+            beginPass({ gpuAccess(removalResource, accessMode::WRITE, resourceUse::BUFFER_UPDATE) });
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, removalBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, removalMoves.size() * sizeof(removalMoves[0]), removalMoves.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            beginPass({
+                gpuAccess(agentResource, accessMode::READ_WRITE, resourceUse::STORAGE_BUFFER),
+                gpuAccess(removalResource, accessMode::READ, resourceUse::STORAGE_BUFFER)
+            });
+            removeShader.use();
+            bindAgentBuffers(removeShader);
+            removeShader.addStorageBuffer("removalMoves", 4, removalBuffer);
+            removeShader.setInt("moveCount", (int)removalMoves.size());
+            dispatchInvocations(removalMoves.size(), REMOVE_GROUP_SIZE);
+        }
+    }
+
+    bool hasPersistentAgentBuffers() const { return agentBuffers.isPersistent(); }
+
+    // Clamped to what the driver supports. The agent shader is compiled for each size the
+    // first time it is used.
+    void setAgentGroupSize(unsigned int size)
+    {
+        agentGroupSize = std::max(1u, std::min(size, (unsigned int)maxGroupSize));
+    }
+
+    // Compiles the shader variants these settings use, so the first step does not have
+    // to. Runs on the compiler when there is one, like the constructor's shaders.
+    void prepareShaders(const SimulationSettings& settings)
+    {
+        std::vector<std::pair<ComputeShader*, std::string>> compiles;
+        std::vector<std::string> paths;
+        const std::pair<ComputeShaderVariants*, std::string> variants[] = {
+            { &agentShaders, getAgentDefines(settings) },
+            { &diffuseBlurShaders, getDiffuseDefines(settings) },
+            { &diffuseDecayShaders, getDiffuseDefines(settings) }
+        };
+        for (const auto& variant : variants)
+        {
+            ComputeShader* shader = variant.first->add(variant.second);
+            if (shader)
+            {
+                compiles.emplace_back(shader, variant.second);
+                paths.push_back(variant.first->getPath());
+            }
+        }
+
+        auto compileShaders = [compiles, paths]()
+        {
+            for (size_t i = 0; i < compiles.size(); i++)
+                compiles[i].first->compileFromPath(paths[i].c_str(), compiles[i].second);
+        };
+
+        if (compiler)
+        {
+            compiler->submit(compileShaders);
+            shadersPending = true;
+        }
+        else
+        {
+            compileShaders();
+        }
+    }
+
+    // Blocks until the shaders given to the compiler are linked, and swaps in any reloaded
+    // ones that have finished. Everything that runs a shader calls it, so it only needs
+    // calling directly to time the compile.
+    void waitForShaders()
+    {
+        if (shadersPending)
+        {
+            compiler->wait();
+            shadersPending = false;
+        }
+
+        swapReloadedShaders();
+    }
+
+    // Recompiles every program that read one of the files, in the background when there
+    // is a compiler. Each is swapped in before the next pass once it has linked, so the
+    // agents and trail map carry on as they were. A program that fails to compile
+    // leaves the old one running.
+    void reloadShaders(const std::vector<std::string>& changedFiles)
+    {
+        waitForShaders();
+
+        std::vector<ComputeShader*> shaders = { &sortCountShader, &sortScanShader, &sortScatterShader, &removeShader };
+        for (ComputeShaderVariants* variants : { &agentShaders, &diffuseBlurShaders, &diffuseDecayShaders })
+        {
+            for (auto& variant : *variants)
+                shaders.push_back(&variant.second);
+        }
+
+        for (ComputeShader* shader : shaders)
+        {
+            if (!shader->usesAnyOf(changedFiles))
+                continue;
+
+            // Compiles a copy, so the original keeps running until the swap
+            ComputeShader replacement = *shader;
+            auto job = [this, shader, replacement]() mutable
+            {
+                if (!replacement.compileAgain())
+                {
+                    std::cerr << "Shader reload failed, keeping the previous program" << std::endl;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(reloadMutex);
+                reloadedShaders.push_back({ shader, replacement });
+            };
+
+            if (compiler)
+                compiler->submit(job);
+            else
+                job();
+        }
+    }
+
+    unsigned int getAgentGroupSize() const { return agentGroupSize; }
+    int getAgentCount() const { return agentCount; }
+
+    void step(const SimulationSettings& settings, float deltaTime) override
+    {
+        waitForShaders();
+
+        glBindImageTexture(0, trails[current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(1, trails[1 - current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+        if (settings.sortInterval > 0 && stepCount % settings.sortInterval == 0)
+            sortAgents();
+
+        writeParams(settings, deltaTime);
+        {
+            GpuTimerScope timer(profiler, "Agents");
+            dispatchAgentPass(settings);
+        }
+
+        // Each diffuse workgroup covers BLUR_TILE texels along its axis, see boxSum.glsl
+        const unsigned int tile = 256 - 2 * MAX_DIFFUSE_RADIUS;
+
+        const bool accumulate = settings.deposit == depositMode::ACCUMULATE;
+
+        {
+            GpuTimerScope timer(profiler, "Diffuse Blur");
+
+            std::vector<resourceAccess> blurAccesses = {
+                gpuAccess(trailResources[current], accessMode::READ, resourceUse::IMAGE),
+                gpuAccess(blurResource, accessMode::WRITE, resourceUse::IMAGE)
+            };
+            if (accumulate)
+                blurAccesses.push_back(gpuAccess(depositResource, accessMode::READ, resourceUse::IMAGE));
+            beginPass(blurAccesses);
+
+            diffuseBlurShaders.get(getDiffuseDefines(settings)).use();
+            glDispatchCompute((width + tile - 1) / tile, height, 1);
+        }
+
+        {
+            GpuTimerScope timer(profiler, "Diffuse Decay");
+
+            std::vector<resourceAccess> decayAccesses = {
+                gpuAccess(blurResource, accessMode::READ, resourceUse::IMAGE),
+                gpuAccess(trailResources[current], accessMode::READ, resourceUse::IMAGE),
+                gpuAccess(trailResources[1 - current], accessMode::WRITE, resourceUse::IMAGE)
+            };
+            if (accumulate)
+                decayAccesses.push_back(gpuAccess(depositResource, accessMode::READ_WRITE, resourceUse::IMAGE));
+            beginPass(decayAccesses);
+
+            diffuseDecayShaders.get(getDiffuseDefines(settings)).use();
+            glDispatchCompute(width, (height + tile - 1) / tile, 1);
+        }
+
+        // The decay pass wrote every texel of the other trail, so it becomes the input
+        current = 1 - current;
+        stepCount++;
+    }
+
+    // Only the agent pass of step(), for timing it on its own. Does not advance the step count.
+    void stepAgents(const SimulationSettings& settings, float deltaTime)
+    {
+        waitForShaders();
+        writeParams(settings, deltaTime);
+
+        GpuTimerScope timer(profiler, "Agents");
+        dispatchAgentPass(settings);
+    }
+
+    // Same stable least significant digit radix sort as CpuSimulation::sortAgents. Each
+    // workgroup counts the digits of a chunk of agents, a single workgroup scans the
+    // counts into where each chunk's agents of each digit start, then each workgroup
+    // moves its chunk's agents there in order. The order depends only on the positions,
+    // so runs that sort are reproducible, and match the CPU backend's agent order.
+    void sortAgents()
+    {
+        const uint32_t tilesX = getTileCount(width);
+        const uint32_t tilesY = getTileCount(height);
+
+        int keyBits = 0;
+        while ((mortonKey(tilesX - 1, tilesY - 1) >> keyBits) != 0)
+            keyBits++;
+
+        if (agentCount == 0 || keyBits == 0)
+            return;
+
+        waitForShaders();
+
+        GpuTimerScope timer(profiler, "Sort");
+
+        const unsigned int chunks = (agentCount + SORT_CHUNK - 1) / SORT_CHUNK;
+        const size_t offsetCount = (size_t)chunks * RADIX_SIZE;
+        if (offsetCount > digitOffsetCapacity)
+        {
+            beginPass({ gpuAccess(digitOffsetResource, accessMode::WRITE, resourceUse::BUFFER_UPDATE) });
+            digitOffsetCapacity = std::max(offsetCount, digitOffsetCapacity * 2);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, digitOffsetBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, digitOffsetCapacity * sizeof(uint32_t), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        for (int shift = 0; shift < keyBits; shift += RADIX_BITS)
+        {
+            beginPass({
+                gpuAccess(agentResource, accessMode::READ, resourceUse::STORAGE_BUFFER),
+                gpuAccess(digitOffsetResource, accessMode::WRITE, resourceUse::STORAGE_BUFFER)
+            });
+            sortCountShader.use();
+            sortCountShader.addStorageBuffer("agentX", 1, agentBuffers.getBuffer(0));
+            sortCountShader.addStorageBuffer("agentY", 2, agentBuffers.getBuffer(1));
+            sortCountShader.addStorageBuffer("digitOffsets", 4, digitOffsetBuffer);
+            setSortUniforms(sortCountShader, tilesX, tilesY, shift, chunks);
+            glDispatchCompute(chunks, 1, 1);
+
+            beginPass({ gpuAccess(digitOffsetResource, accessMode::READ_WRITE, resourceUse::STORAGE_BUFFER) });
+            sortScanShader.use();
+            sortScanShader.addStorageBuffer("digitOffsets", 4, digitOffsetBuffer);
+            sortScanShader.setUnsignedInt("offsetCount", (unsigned int)offsetCount);
+            glDispatchCompute(1, 1, 1);
+
+            beginPass({
+                gpuAccess(agentResource, accessMode::READ, resourceUse::STORAGE_BUFFER),
+                gpuAccess(digitOffsetResource, accessMode::READ, resourceUse::STORAGE_BUFFER),
+                gpuAccess(sortedResource, accessMode::WRITE, resourceUse::STORAGE_BUFFER)
+            });
+            sortScatterShader.use();
+            bindAgentBuffers(sortScatterShader);
+            sortScatterShader.addStorageBuffer("digitOffsets", 4, digitOffsetBuffer);
+            sortScatterShader.addStorageBuffer("sortedX", 5, agentBuffers.getSpareBuffer(0));
+            sortScatterShader.addStorageBuffer("sortedY", 6, agentBuffers.getSpareBuffer(1));
+            sortScatterShader.addStorageBuffer("sortedAngle", 7, agentBuffers.getSpareBuffer(2));
+            setSortUniforms(sortScatterShader, tilesX, tilesY, shift, chunks);
+            glDispatchCompute(chunks, 1, 1);
+
+            // The sorted copy becomes the agents, and the old buffers are reused next pass
+            agentBuffers.swap();
+            std::swap(agentResource, sortedResource);
+        }
+    }
+
+    void finish() override { glFinish(); }
+
+    unsigned int getTexture() override
+    {
+        beginPass({ gpuAccess(trailResources[current], accessMode::READ, resourceUse::TEXTURE_FETCH) });
+        return trails[current];
+    }
+private:
+    // Issues the barrier for whatever the pass touches that an earlier shader wrote.
+    // Only shader writes need one, so a pass that only reads what earlier passes also
+    // only read runs without a barrier.
+    void beginPass(const std::vector<resourceAccess>& accesses)
+    {
+        unsigned int uses = graph.pass(accesses);
+
+        GLbitfield barrier = 0;
+        if (uses & (unsigned int)resourceUse::IMAGE) barrier |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        if (uses & (unsigned int)resourceUse::STORAGE_BUFFER) barrier |= GL_SHADER_STORAGE_BARRIER_BIT;
+        if (uses & (unsigned int)resourceUse::TEXTURE_FETCH) barrier |= GL_TEXTURE_FETCH_BARRIER_BIT;
+        if (uses & (unsigned int)resourceUse::FRAMEBUFFER) barrier |= GL_FRAMEBUFFER_BARRIER_BIT;
+        if (uses & (unsigned int)resourceUse::TEXTURE_UPDATE) barrier |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+        if (uses & (unsigned int)resourceUse::BUFFER_UPDATE) barrier |= GL_BUFFER_UPDATE_BARRIER_BIT;
+
+        if (barrier)
+            glMemoryBarrier(barrier);
+    }
+
+    void swapReloadedShaders()
+    {
+        std::lock_guard<std::mutex> lock(reloadMutex);
+        for (reloadedShader& reloaded : reloadedShaders)
+        {
+            glDeleteProgram(reloaded.shader->ID);
+            *reloaded.shader = reloaded.replacement;
+        }
+        reloadedShaders.clear();
+    }
+
+    // Waits for reloads still compiling and swaps them in
+    void finishReloads()
+    {
+        if (compiler)
+            compiler->wait();
+        swapReloadedShaders();
+    }
+
+    // One buffer write in place of setting each uniform of the agent and diffuse passes
+    void writeParams(const SimulationSettings& settings, float deltaTime)
+    {
+        simulationParams params;
+        params.agentCount = agentCount;
+        params.stepIndex = stepCount;
+        params.seed = settings.seed;
+        params.deltaTime = deltaTime;
+        params.movementDistance = settings.movementDistance;
+        params.sensorDistance = settings.sensorDistance;
+        params.sensorAngle = settings.sensorAngle;
+        params.rotationAngle = settings.rotationAngle;
+        params.accumulateDeposits = settings.deposit == depositMode::ACCUMULATE;
+        params.depositAmount = settings.depositAmount;
+        params.radius = glm::clamp(settings.diffuseRadius, 0, MAX_DIFFUSE_RADIUS);
+        params.decayAmount = settings.decayAmount;
+        params.diffuseSpeed = settings.diffuseSpeed;
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+    }
+
+    // The agent pass, with its settings already in paramsBuffer
+    void dispatchAgentPass(const SimulationSettings& settings)
+    {
+        if (agentCount == 0)
+            return;
+
+        // Overwriting stores straight into the trail, accumulating counts in the deposit image
+        const bool accumulate = settings.deposit == depositMode::ACCUMULATE;
+        std::vector<resourceAccess> accesses = {
+            gpuAccess(agentResource, accessMode::READ_WRITE, resourceUse::STORAGE_BUFFER),
+            gpuAccess(trailResources[current], accumulate ? accessMode::READ : accessMode::READ_WRITE, resourceUse::IMAGE)
+        };
+        if (accumulate)
+            accesses.push_back(gpuAccess(depositResource, accessMode::READ_WRITE, resourceUse::IMAGE));
+        beginPass(accesses);
+
+        ComputeShader& agentShader = agentShaders.get(getAgentDefines(settings));
+        agentShader.use();
+        bindAgentBuffers(agentShader);
+        dispatchAgents(agentGroupSize);
+    }
+
+    // Makes room for count agents and waits until their staging memory can be written
+    void beginAgentWrite(size_t count)
+    {
+        // Growing copies the agents, and uploading overwrites what the shaders wrote
+        beginPass({ gpuAccess(agentResource, accessMode::WRITE, resourceUse::BUFFER_UPDATE) });
+
+        agentBuffers.reserve(count, 0);
+        agentBuffers.waitForUploads();
+
+        agentCount = count;
+        stepCount = 0;
+    }
+
+    void clearTrail()
+    {
+        beginPass({
+            gpuAccess(trailResources[0], accessMode::WRITE, resourceUse::FRAMEBUFFER),
+            gpuAccess(trailResources[1], accessMode::WRITE, resourceUse::FRAMEBUFFER),
+            gpuAccess(depositResource, accessMode::WRITE, resourceUse::FRAMEBUFFER)
+        });
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        for (unsigned int trail : trails)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, trail, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+
+        const GLuint zero[4] = { 0, 0, 0, 0 };
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depositTexture, 0);
+        glClearBufferuiv(GL_COLOR, 0, zero);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void bindAgentBuffers(ComputeShader& shader)
+    {
+        shader.addStorageBuffer("agentX", 1, agentBuffers.getBuffer(0));
+        shader.addStorageBuffer("agentY", 2, agentBuffers.getBuffer(1));
+        shader.addStorageBuffer("agentAngle", 3, agentBuffers.getBuffer(2));
+    }
+
+    // One invocation per agent
+    void dispatchAgents(unsigned int groupSize)
+    {
+        dispatchInvocations(agentCount, groupSize);
+    }
+
+    // Split into rows of workgroups when there are more than one dimension allows
+    void dispatchInvocations(size_t count, unsigned int groupSize)
+    {
+        unsigned int groups = (count + groupSize - 1) / groupSize;
+        unsigned int rows = (groups + maxGroupCount - 1) / maxGroupCount;
+        unsigned int columns = (groups + rows - 1) / rows;
+        glDispatchCompute(columns, rows, 1);
+    }
+
+    void setSortUniforms(ComputeShader& shader, uint32_t tilesX, uint32_t tilesY, int shift, unsigned int chunks)
+    {
+        shader.setInt("agentCount", agentCount);
+        shader.setUnsignedInt("tilesX", tilesX);
+        shader.setUnsignedInt("tilesY", tilesY);
+        shader.setUnsignedInt("shift", (unsigned int)shift);
+        shader.setUnsignedInt("chunkCount", chunks);
+    }
+
+    static unsigned int getTileCount(unsigned int size)
+    {
+        return (size + AGENT_SORT_TILE - 1) / AGENT_SORT_TILE;
+    }
+
+    // The group size and deposit mode are compiled into the agent shader, so the deposit
+    // branch folds away
+    std::string getAgentDefines(const SimulationSettings& settings) const
+    {
+        return "#define AGENT_GROUP_SIZE " + std::to_string(agentGroupSize) + "\n"
+            + "#define ACCUMULATE " + (settings.deposit == depositMode::ACCUMULATE ? "1" : "0");
+    }
+
+    // Small radii are compiled in too, which unrolls the box sum, see boxSum.glsl. Larger
+    // ones share the variant that scans and reads the radius from the uniform block.
+    std::string getDiffuseDefines(const SimulationSettings& settings) const
+    {
+        std::string defines = std::string("#define ACCUMULATE ") + (settings.deposit == depositMode::ACCUMULATE ? "1" : "0");
+
+        int radius = glm::clamp(settings.diffuseRadius, 0, MAX_DIFFUSE_RADIUS);
+        if (radius <= MAX_UNROLLED_DIFFUSE_RADIUS)
+            defines += "\n#define DIFFUSE_RADIUS " + std::to_string(radius);
+        return defines;
+    }
+
+    void generateTexture(unsigned int& id, GLint filter)
+    {
+        glGenTextures(1, &id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    }
+
+    // (Re)allocates everything sized by the trail map. Shaders take the size from
+    // imageSize and bounds check against it, so they need no other change.
+    void allocateTrail()
+    {
+        for (unsigned int trail : trails)
+        {
+            glBindTexture(GL_TEXTURE_2D, trail);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+        }
+        glBindTexture(GL_TEXTURE_2D, blurTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, depositTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Trails are bound again each step, as they swap
+        glBindImageTexture(0, trails[current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(1, trails[1 - current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(2, blurTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(3, depositTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    }
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit FNV-1a, for checksums and cache keys rather than hash tables. Start from
+// HASH_OFFSET_BASIS and feed each buffer through hashBytes in turn.
+const uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ull;
+
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+#endif
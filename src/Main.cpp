@@ -7,9 +7,27 @@
 #include <string>
 
 #include "Shader.hpp"
+#include "ShaderCompiler.hpp"
+#include "ShaderWatcher.hpp"
+#include "SimulationBackend.hpp"
+#include "GpuBackend.hpp"
+#include "CpuBackend.hpp"
+#include "Snapshot.hpp"
+#include "SimulationClock.hpp"
+#include "AgentSpawner.hpp"
+#include "ThreadPool.hpp"
+#include "Roofline.hpp"
+#include "Profiler.hpp"
 
 #include <vector>
 #include <ctime>
+#include <chrono>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <system_error>
 
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
@@ -26,66 +44,104 @@ https://www.sagejenson.com/physarum
 const unsigned int SCREEN_WIDTH  = 1280;
 const unsigned int SCREEN_HEIGHT = 720;
 
-const unsigned int TEXTURE_WIDTH  = 1280; // 960 1280 1920 2560
-const unsigned int TEXTURE_HEIGHT = 720; // 540 720 1080 1440
+const unsigned int DEFAULT_TRAIL_WIDTH  = 1280;
+const unsigned int DEFAULT_TRAIL_HEIGHT = 720;
 
 const float DEFAULT_DECAY_AMOUNT = 0.3f;
 const float DEFAULT_DIFFUSE_SPEED = 0.3f;
+const int DEFAULT_DIFFUSE_RADIUS = 1;
+const float DEFAULT_DEPOSIT_AMOUNT = 1.0f;
 const float DEFAULT_MOVEMENT_DISTANCE = 10.0f;
 
 const float DEFAULT_SENSOR_DISTANCE = 4.0f;
 const float DEFAULT_SENSOR_ANGLE = 45.0f;
 const float DEFAULT_ROTATION = 45.0f;
 
-const int DEFAULT_SPAWN_RADIUS = TEXTURE_HEIGHT / 2;
-
 const int DEFAULT_AGENT_COUNT = 2500000;
 
+const int DEFAULT_SORT_INTERVAL = 0;
+
+const glm::vec4 DEFAULT_SLIME_COLOUR = glm::vec4(175.0f / 255.0f, 217.0f / 255.0f, 255.0f / 255.0f, 255.0f / 255.0f);
+
 float DECAY_AMOUNT, DIFFUSE_SPEED, MOVEMENT_DISTANCE;
+int DIFFUSE_RADIUS;
+float DEPOSIT_AMOUNT;
+depositMode DEPOSIT_MODE = depositMode::OVERWRITE;
 float SENSOR_DISTANCE, SENSOR_ANGLE, ROTATION;
 int SPAWN_RADIUS;
+unsigned int TRAIL_WIDTH = DEFAULT_TRAIL_WIDTH;
+unsigned int TRAIL_HEIGHT = DEFAULT_TRAIL_HEIGHT;
 int AGENT_COUNT;
+int SORT_INTERVAL;
+unsigned int SEED;
 
-struct agent
+generationType generation = generationType::IN_CIRCLE;
+
+enum class backendType
 {
-    glm::vec3 pos;
-    float angle;
+    AUTO,
+    GPU,
+    CPU
 };
 
-enum class generationType
+struct options
 {
-    IN_CIRCLE,
-    OUT_CIRCLE,
-    RANDOM
+    backendType backend = backendType::AUTO;
+
+    bool headless = false;
+    int steps = 1000;
+    float timestep = 1.0f / 60.0f;
+    int snapshotInterval = 0;
+    std::string outputDirectory = ".";
+    unsigned int threads = 0;
+    agentPrecision precision = agentPrecision::FLOAT32;
+    agentKernelType kernel = agentKernelType::AUTO;
+    unsigned int agentGroupSize = GpuBackend::DEFAULT_AGENT_GROUP_SIZE;
+    glm::uvec2 diffuseTile = glm::uvec2(CpuSimulation::DEFAULT_DIFFUSE_TILE_WIDTH, CpuSimulation::DEFAULT_DIFFUSE_TILE_HEIGHT);
+
+    glm::vec4 colour = DEFAULT_SLIME_COLOUR;
 };
 
-generationType generation = generationType::IN_CIRCLE;
+bool parseArguments(int argc, char* argv[], options& opts);
 
-#define PI 3.14159
-float degToRad(float deg)
-{
-    return deg * (PI / 180.0);
-}
+int runHeadless(const options& opts, ThreadPool& pool);
 
-float radToDeg(float rad)
-{
-    return rad * (180.0 / PI);
-}
+void resetValues();
 
-void generateTexture(unsigned int& id, unsigned int width, unsigned int height, unsigned int binding, GLenum access);
+void reset(SimulationBackend& backend, ThreadPool& pool);
 
-void resetValues();
+SpawnSettings getSpawnSettings();
 
-void reset(unsigned int ssbo, unsigned int fbo, unsigned int texture);
+SimulationSettings getSettings();
 
-agent generateInwardCircle(int radius = 100);
+struct groupSizeResult
+{
+    unsigned int groupSize;
+    double agentsPerSecond;
+};
+
+std::vector<groupSizeResult> measureAgentGroupSizes(GpuBackend& backend, const SimulationSettings& settings, float timestep);
 
-agent generateOutwardCircle(int radius = 100);
+void drawPassTimings(const Profiler& profiler);
 
-agent generateRandom();
+bool isTrailSizeSupported(glm::uvec2 size, glm::uvec2 maxSize);
 
 int main(int argc, char* argv[])
 {
+    resetValues();
+    SEED = (unsigned int)time(0);
+
+    options opts;
+    if (!parseArguments(argc, argv, opts))
+        return 1;
+
+    ThreadPool pool(opts.threads);
+
+    if (opts.headless)
+        return runHeadless(opts, pool);
+
+    backendType requestedBackend = opts.backend;
+
     SDL_Init(SDL_INIT_VIDEO);
 
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
@@ -97,18 +153,81 @@ int main(int argc, char* argv[])
     SDL_Window* window = SDL_CreateWindow("SlimeMouldSimulation", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_OPENGL);
     SDL_GLContext context = SDL_GL_CreateContext(window);
 
+    // Without compute shader support only the CPU backend can run, which just needs something to draw with
+    bool computeSupported = context != NULL;
+    if (!context)
+    {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        context = SDL_GL_CreateContext(window);
+    }
+
+    if (!context)
+    {
+        std::cerr << "ERROR::SDL: Unable to create an OpenGL context: " << SDL_GetError() << std::endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
     gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
     SDL_GL_SetSwapInterval(0);
 
+    computeSupported = computeSupported && (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3));
+
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    unsigned int texture;
-    generateTexture(texture, TEXTURE_WIDTH, TEXTURE_HEIGHT, 0, GL_READ_WRITE);
+    if (requestedBackend == backendType::GPU && !computeSupported)
+        std::cerr << "OpenGL 4.3 is not available, falling back to the CPU backend" << std::endl;
+
+    // Checked before anything is allocated at the requested size
+    bool useCpu = requestedBackend == backendType::CPU || !computeSupported;
+    glm::uvec2 maxTrailSize = useCpu ? CpuBackend::getMaxTrailSize() : GpuBackend::getMaxTrailSize();
+    if (!isTrailSizeSupported(glm::uvec2(TRAIL_WIDTH, TRAIL_HEIGHT), maxTrailSize))
+    {
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    // Shaders compile on a shared context while the rest of startup runs, and programs
+    // linked on an earlier run are loaded from the binary cache instead
+    auto compileStart = std::chrono::steady_clock::now();
+    std::unique_ptr<ShaderCompiler> compiler(new ShaderCompiler(window, context));
+
+    Shader basic;
+    compiler->submit([&basic]()
+    {
+        basic.compileFromPath("res/Shaders/vertexShader.glsl", "res/Shaders/fragmentShader.glsl");
+    });
+
+    std::unique_ptr<SimulationBackend> backend;
+    CpuBackend* cpuBackend = nullptr;
+    GpuBackend* gpuBackend = nullptr;
+    if (useCpu)
+    {
+        cpuBackend = new CpuBackend(pool, TRAIL_WIDTH, TRAIL_HEIGHT);
+        cpuBackend->getSimulation().setAgentPrecision(opts.precision);
+        cpuBackend->getSimulation().setAgentKernel(opts.kernel);
+        cpuBackend->getSimulation().setDiffuseTileSize(opts.diffuseTile.x, opts.diffuseTile.y);
+        backend.reset(cpuBackend);
+    }
+    else
+    {
+        gpuBackend = new GpuBackend(TRAIL_WIDTH, TRAIL_HEIGHT, compiler.get());
+        gpuBackend->setAgentGroupSize(opts.agentGroupSize);
+        gpuBackend->prepareShaders(getSettings());
+        backend.reset(gpuBackend);
+    }
 
-    unsigned int output;
-    generateTexture(output, TEXTURE_WIDTH, TEXTURE_HEIGHT, 1, GL_READ_WRITE);
+    // Times each pass of every frame, for the histograms in the settings window and trace export
+    std::unique_ptr<Profiler> profiler(new Profiler());
+    backend->setProfiler(profiler.get());
+    std::string traceStatus;
+    std::string trailSizeStatus;
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -119,24 +238,6 @@ int main(int argc, char* argv[])
     ImGui_ImplSDL2_InitForOpenGL(window, context);
     ImGui_ImplOpenGL3_Init("#version 330");
 
-    Shader basic;
-    basic.compileFromPath("res/Shaders/vertexShader.glsl", "res/Shaders/fragmentShader.glsl");
-    basic.setInt("tex", 0);
-
-    ComputeShader basicShader;
-    basicShader.compileFromPath("res/Shaders/basicComputeShader.glsl");
-
-    ComputeShader agentShader;
-    agentShader.compileFromPath("res/Shaders/agentComputeShader.glsl");
-
-    ComputeShader diffuseDecayShader;
-    diffuseDecayShader.compileFromPath("res/Shaders/diffuseDecayCompute.glsl");
-
-    ComputeShader colourShader;
-    colourShader.compileFromPath("res/Shaders/colourComputeShader.glsl");
-
-    srand(time(0));  
-
     float vertexData[] = {
         -1.0f,  1.0f, 0.0f, 1.0f,
          1.0f, -1.0f, 1.0f, 0.0f,
@@ -160,31 +261,61 @@ int main(int argc, char* argv[])
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    unsigned int fbo;
-    glGenFramebuffers(1, &fbo);
+    reset(*backend, pool);
 
-    unsigned int ssbo;
-    glGenBuffers(1, &ssbo);
+    auto waitStart = std::chrono::steady_clock::now();
+    compiler->wait();
+    auto compileEnd = std::chrono::steady_clock::now();
+    std::cout << "Shaders ready " << std::chrono::duration<double, std::milli>(compileEnd - compileStart).count() << " ms into startup, "
+        << std::chrono::duration<double, std::milli>(compileEnd - waitStart).count() << " ms of it waited for, "
+        << (compiler->isAsync() ? "compiled on a shared context. " : "compiled on the main thread. ")
+        << ShaderCache::hits << " programs loaded from the binary cache, " << ShaderCache::misses << " compiled" << std::endl;
 
-    resetValues();
-    reset(ssbo, fbo, texture);
+    basic.use();
+    basic.setInt("tex", 0);
+
+    // Edited shaders are recompiled and swapped in without restarting
+    ShaderWatcher shaderWatcher("res/Shaders");
 
     float deltaTime = 0.0f;
-    float lastTime = 0.0f;
+    auto lastTime = std::chrono::steady_clock::now();
 
-    // basicShader.use();
-    // glDispatchCompute(80, 80, 1);
-    // glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    SimulationClock clock(opts.timestep);
+    int simulationRate = (int)(1.0f / opts.timestep + 0.5f);
 
     const char* generationTypeLabels[] = { "Inward Circle", "Outward Circle", "Random" };
-    int generationIndex = 0;
+    int generationIndex = (int)generation;
+
+    ImVec4 slimeColour = ImVec4(opts.colour.r, opts.colour.g, opts.colour.b, opts.colour.a);
 
-    ImVec4 slimeColour = ImVec4(175.0f / 255.0f, 217.0f / 255.0f, 255.0f / 255.0f, 255.0f / 255.0f);
+    const char* groupSizeLabels[] = { "32", "64", "128", "256", "512", "1024" };
+
+    const char* trailSizeLabels[] = { "720p", "1080p", "1440p", "4K", "8K" };
+    const glm::uvec2 trailSizes[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 } };
+    std::vector<groupSizeResult> groupSizeResults;
+
+    // Only needed for the CPU backend's roofline, and takes a moment
+    double memoryBandwidth = cpuBackend ? measureMemoryBandwidth(pool) : 0.0;
 
     bool running = true;
     bool paused = true;
     while (running)
     {
+        profiler->beginFrame();
+
+        std::vector<std::string> changedShaders = shaderWatcher.poll();
+        if (!changedShaders.empty())
+        {
+            if (gpuBackend)
+                gpuBackend->reloadShaders(changedShaders);
+
+            if (basic.usesAnyOf(changedShaders) && reloadShader(basic))
+            {
+                basic.use();
+                basic.setInt("tex", 0);
+            }
+        }
+
         SDL_Event event;
         while (SDL_PollEvent(&event))
         {
@@ -210,8 +341,8 @@ int main(int argc, char* argv[])
         ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
 
-        float currentTime = SDL_GetTicks() / 1000.0f;
-        deltaTime = currentTime - lastTime;
+        auto currentTime = std::chrono::steady_clock::now();
+        deltaTime = std::chrono::duration<float>(currentTime - lastTime).count();
         lastTime = currentTime;
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -223,8 +354,51 @@ int main(int argc, char* argv[])
         ImGui::Dummy(ImVec2(1.0f, 1.0f));
         ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Information");
 
+        ImGui::Text("Backend: %s", backend->getName());
+        if (cpuBackend)
+        {
+            const CpuSimulation& simulation = cpuBackend->getSimulation();
+            double agentPass = simulation.getAgentPassSeconds();
+            double agentRate = agentPass > 0.0 ? simulation.getAgents().size() / agentPass : 0.0;
+
+            ImGui::Text("Agent kernel: %s", getAgentKernelName(simulation.getAgentKernel()));
+            ImGui::Text("Agent pass: %.1f M agent steps/s, %.0f bytes/agent", agentRate / 1e6, simulation.getBytesPerAgentStep());
+            ImGui::Text("Roofline: %.1f M agent steps/s at %.1f GB/s",
+                agentRoofline(memoryBandwidth, simulation.getBytesPerAgentStep()) / 1e6, memoryBandwidth / 1e9);
+            if (SORT_INTERVAL > 0)
+                ImGui::Text("Agent sort: %.2f ms", simulation.getSortSeconds() * 1e3);
+        }
         ImGui::Text("FPS: %.2f", 1 / deltaTime);
         ImGui::Text("Delta time: %.5f", deltaTime);
+        ImGui::Text("Steps per second: %.1f", clock.getStepsPerSecond());
+        ImGui::Text("Simulation steps per second: %.1f", clock.getSimulationStepsPerSecond());
+
+        if (gpuBackend)
+        {
+            ImGui::Text("Agent uploads: %s", gpuBackend->hasPersistentAgentBuffers() ? "persistent mapped" : "glBufferSubData");
+            ImGui::Text("Agent Group Size:");
+            if (ImGui::BeginCombo("##AgentGroupSize", std::to_string(gpuBackend->getAgentGroupSize()).c_str(), 0))
+            {
+                for (int i = 0; i < IM_ARRAYSIZE(groupSizeLabels); i++)
+                {
+                    unsigned int size = 32u << i;
+                    bool isSelected = size == gpuBackend->getAgentGroupSize();
+                    if (ImGui::Selectable(groupSizeLabels[i], isSelected))
+                        gpuBackend->setAgentGroupSize(size);
+
+                    if (isSelected)
+                        ImGui::SetItemDefaultFocus();
+                }
+                ImGui::EndCombo();
+            }
+
+            // Moves the agents, so the simulation carries on from a slightly different state
+            if (ImGui::Button("Measure Group Sizes"))
+                groupSizeResults = measureAgentGroupSizes(*gpuBackend, getSettings(), clock.timestep);
+
+            for (const groupSizeResult& result : groupSizeResults)
+                ImGui::Text("%5u: %.1f M agents/s", result.groupSize, result.agentsPerSecond / 1e6);
+        }
 
         ImGui::Text("Generation Type:");
         ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.5f);
@@ -259,14 +433,61 @@ int main(int argc, char* argv[])
 
         ImGui::SliderFloat("Decay Amount", &DECAY_AMOUNT, 0.0f, 1.0f, "%.3f", 0);
         ImGui::SliderFloat("Diffuse Speed", &DIFFUSE_SPEED, 0.0f, 1.0f, "%.3f", 0);
+        ImGui::SliderInt("Diffuse Radius", &DIFFUSE_RADIUS, 0, MAX_DIFFUSE_RADIUS, "%d", 0);
+        bool accumulate = DEPOSIT_MODE == depositMode::ACCUMULATE;
+        if (ImGui::Checkbox("Accumulate Deposits", &accumulate))
+            DEPOSIT_MODE = accumulate ? depositMode::ACCUMULATE : depositMode::OVERWRITE;
+        // Accumulated trails grow with the agent density, so they usually want a much smaller amount
+        ImGui::SliderFloat("Deposit Amount", &DEPOSIT_AMOUNT, 0.0001f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
         ImGui::SliderFloat("Movement Distance", &MOVEMENT_DISTANCE, 2.0f, 15.0f, "%.3f", 0);
 
         ImGui::SliderFloat("Sensor Distance", &SENSOR_DISTANCE, 1.0f, 8.0f, "%.3f", 0);
         ImGui::SliderFloat("Sensor Angle", &SENSOR_ANGLE, 10.0f, 90.0f, "%.3f", 0);
         ImGui::SliderFloat("Rotation", &ROTATION, 5.0f, 45.0f, "%.3f", 0);
 
-        ImGui::SliderInt("Spawn Radius", &SPAWN_RADIUS, 0, SCREEN_HEIGHT, "%d", 0);
-        ImGui::SliderInt("Agent Count", &AGENT_COUNT, 1000000, 5000000, "%d", 0);
+        ImGui::Text("Trail Size:");
+        std::string trailSizeLabel = std::to_string(TRAIL_WIDTH) + "x" + std::to_string(TRAIL_HEIGHT);
+        if (ImGui::BeginCombo("##TrailSize", trailSizeLabel.c_str(), 0))
+        {
+            for (int i = 0; i < IM_ARRAYSIZE(trailSizes); i++)
+            {
+                bool isSelected = trailSizes[i] == glm::uvec2(TRAIL_WIDTH, TRAIL_HEIGHT);
+                if (ImGui::Selectable(trailSizeLabels[i], isSelected) && !isSelected)
+                {
+                    // The current size is kept when the driver cannot allocate the new one
+                    if (isTrailSizeSupported(trailSizes[i], maxTrailSize))
+                    {
+                        // The trail map is reallocated, so the agents are spawned again for the new size
+                        TRAIL_WIDTH = trailSizes[i].x;
+                        TRAIL_HEIGHT = trailSizes[i].y;
+                        SPAWN_RADIUS = TRAIL_HEIGHT / 2;
+                        backend->resize(TRAIL_WIDTH, TRAIL_HEIGHT);
+                        reset(*backend, pool);
+                        trailSizeStatus.clear();
+                    }
+                    else
+                    {
+                        trailSizeStatus = std::string(trailSizeLabels[i]) + " is larger than the driver supports";
+                    }
+                }
+
+                if (isSelected)
+                    ImGui::SetItemDefaultFocus();
+            }
+            ImGui::EndCombo();
+        }
+        if (!trailSizeStatus.empty())
+            ImGui::Text("%s", trailSizeStatus.c_str());
+
+        ImGui::SliderInt("Spawn Radius", &SPAWN_RADIUS, 0, (int)TRAIL_HEIGHT, "%d", 0);
+        // Takes effect straight away, adding or removing only the difference
+        if (ImGui::SliderInt("Agent Count", &AGENT_COUNT, 1000000, 5000000, "%d", 0))
+            backend->setAgentCount(pool, getSpawnSettings(), AGENT_COUNT);
+
+        if (ImGui::SliderInt("Simulation Rate", &simulationRate, 10, 240, "%d Hz", 0))
+            clock.timestep = 1.0f / simulationRate;
+        ImGui::SliderInt("Max Substeps", &clock.maxSubsteps, 1, 32, "%d", 0);
+        ImGui::SliderInt("Sort Interval", &SORT_INTERVAL, 0, 240, SORT_INTERVAL > 0 ? "%d steps" : "Never", 0);
 
         ImGui::Text("Color widget:");
         ImGui::ColorEdit4("Slime Colour", (float*)&slimeColour, 0);
@@ -277,60 +498,93 @@ int main(int argc, char* argv[])
             paused = !paused;
         }
 
+        ImGui::InputScalar("Seed", ImGuiDataType_U32, &SEED);
+
         if (ImGui::Button("Reset"))
         {
-            reset(ssbo, fbo, texture);
+            reset(*backend, pool);
         }
 
         if (ImGui::Button("Reset Values"))
         {
+            int previousAgentCount = AGENT_COUNT;
             resetValues();
+            // The agent count applies straight away, like the slider
+            if (AGENT_COUNT != previousAgentCount)
+                backend->setAgentCount(pool, getSpawnSettings(), AGENT_COUNT);
+        }
+
+        if (ImGui::CollapsingHeader("Pass Timings"))
+        {
+            drawPassTimings(*profiler);
+
+            if (ImGui::Button("Export Chrome Trace"))
+                traceStatus = profiler->writeChromeTrace("trace.json") ? "Wrote trace.json" : "Unable to write trace.json";
+            if (!traceStatus.empty())
+                ImGui::Text("%s", traceStatus.c_str());
         }
 
         ImGui::End();
 
         if (!paused)
         {
-            agentShader.use();
-            agentShader.addStorageBuffer("bufferData", 1, ssbo);
-            agentShader.setInt("agentCount", AGENT_COUNT);
-            agentShader.setFloat("movementDistance", MOVEMENT_DISTANCE);
-            agentShader.setFloat("deltaTime", deltaTime);
-            agentShader.setFloat("sensorDistance", SENSOR_DISTANCE);
-            agentShader.setFloat("sensorAngle", SENSOR_ANGLE);
-            agentShader.setFloat("rotationAngle", ROTATION);
-            glDispatchCompute(AGENT_COUNT, 1, 1);
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-            diffuseDecayShader.use();
-            diffuseDecayShader.setFloat("decayAmount", DECAY_AMOUNT);
-            diffuseDecayShader.setFloat("diffuseSpeed", DIFFUSE_SPEED);
-            diffuseDecayShader.setFloat("deltaTime", deltaTime);
-            glDispatchCompute(TEXTURE_WIDTH / 8, TEXTURE_HEIGHT / 8, 1);
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-            colourShader.use();
-            colourShader.setVector4f("targetColour", glm::vec4(slimeColour.x, slimeColour.y, slimeColour.z, slimeColour.w));
-            glDispatchCompute(TEXTURE_WIDTH / 8, TEXTURE_HEIGHT / 8, 1);
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-
-            glCopyImageSubData(output, GL_TEXTURE_2D, 0, 0, 0, 0, texture, GL_TEXTURE_2D, 0, 0, 0, 0, TEXTURE_WIDTH, TEXTURE_HEIGHT, 1);
+            SimulationSettings settings = getSettings();
+            int steps = clock.advance(deltaTime);
+
+            auto stepStart = std::chrono::steady_clock::now();
+            {
+                CpuTimerScope timer(profiler.get(), "Simulation");
+                for (int i = 0; i < steps; i++)
+                    backend->step(settings, clock.timestep);
+                if (steps > 0)
+                    backend->finish();
+            }
+            double stepTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count();
+
+            clock.record(deltaTime, steps, stepTime);
+        }
+        else
+        {
+            clock.hold();
+            clock.record(deltaTime, 0, 0.0);
         }
 
-        basic.use();
-        glBindVertexArray(VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        // The CPU backend uploads its trail here, which it times as its own pass
+        unsigned int trailTexture = backend->getTexture();
+        {
+            GpuTimerScope timer(profiler.get(), "Colour");
 
-        glDrawArrays(GL_TRIANGLES, 0 ,6);
-        glBindVertexArray(0);
+            basic.use();
+            basic.setVector4f("slimeColour", glm::vec4(slimeColour.x, slimeColour.y, slimeColour.z, slimeColour.w));
+            glBindVertexArray(VAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, trailTexture);
 
-        ImGui::Render();
+            glDrawArrays(GL_TRIANGLES, 0 ,6);
+            glBindVertexArray(0);
+        }
+
+        {
+            CpuTimerScope cpuTimer(profiler.get(), "ImGui");
+            GpuTimerScope gpuTimer(profiler.get(), "ImGui");
+
+            ImGui::Render();
+
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        {
+            CpuTimerScope timer(profiler.get(), "Swap");
+            SDL_GL_SwapWindow(window);
+        }
 
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(window);
+        profiler->endFrame();
     }
 
+    backend.reset();
+    profiler.reset();
+    compiler.reset();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -343,93 +597,331 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-void generateTexture(unsigned int& id, unsigned int width, unsigned int height, unsigned int binding, GLenum access)
+bool parseArguments(int argc, char* argv[], options& opts)
 {
-    glGenTextures(1, &id);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glBindImageTexture(binding, id, 0, GL_FALSE, 0, access, GL_RGBA32F);
+    bool spawnRadiusGiven = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+
+        if (strcmp(argument, "--gpu") == 0) { opts.backend = backendType::GPU; continue; }
+        if (strcmp(argument, "--cpu") == 0) { opts.backend = backendType::CPU; continue; }
+        if (strcmp(argument, "--headless") == 0) { opts.headless = true; continue; }
+
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Unknown argument or missing value: " << argument << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(argument, "--steps") == 0) opts.steps = atoi(value);
+        else if (strcmp(argument, "--timestep") == 0) opts.timestep = atof(value);
+        else if (strcmp(argument, "--snapshot-interval") == 0) opts.snapshotInterval = atoi(value);
+        else if (strcmp(argument, "--output") == 0) opts.outputDirectory = value;
+        else if (strcmp(argument, "--threads") == 0) opts.threads = atoi(value);
+        else if (strcmp(argument, "--agent-group-size") == 0) opts.agentGroupSize = atoi(value);
+        else if (strcmp(argument, "--seed") == 0) SEED = strtoul(value, NULL, 10);
+        else if (strcmp(argument, "--agents") == 0) AGENT_COUNT = atoi(value);
+        else if (strcmp(argument, "--sort-interval") == 0) SORT_INTERVAL = atoi(value);
+        else if (strcmp(argument, "--spawn-radius") == 0)
+        {
+            SPAWN_RADIUS = atoi(value);
+            spawnRadiusGiven = true;
+        }
+        else if (strcmp(argument, "--decay") == 0) DECAY_AMOUNT = atof(value);
+        else if (strcmp(argument, "--diffuse") == 0) DIFFUSE_SPEED = atof(value);
+        else if (strcmp(argument, "--diffuse-radius") == 0) DIFFUSE_RADIUS = atoi(value);
+        else if (strcmp(argument, "--deposit-amount") == 0) DEPOSIT_AMOUNT = atof(value);
+        else if (strcmp(argument, "--deposit") == 0)
+        {
+            if (strcmp(value, "overwrite") == 0) DEPOSIT_MODE = depositMode::OVERWRITE;
+            else if (strcmp(value, "accumulate") == 0) DEPOSIT_MODE = depositMode::ACCUMULATE;
+            else
+            {
+                std::cerr << "Expected --deposit overwrite|accumulate" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--movement") == 0) MOVEMENT_DISTANCE = atof(value);
+        else if (strcmp(argument, "--sensor-distance") == 0) SENSOR_DISTANCE = atof(value);
+        else if (strcmp(argument, "--sensor-angle") == 0) SENSOR_ANGLE = atof(value);
+        else if (strcmp(argument, "--rotation") == 0) ROTATION = atof(value);
+        else if (strcmp(argument, "--colour") == 0)
+        {
+            if (sscanf(value, "%f,%f,%f", &opts.colour.r, &opts.colour.g, &opts.colour.b) != 3)
+            {
+                std::cerr << "Expected --colour r,g,b" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--trail-size") == 0)
+        {
+            if (sscanf(value, "%ux%u", &TRAIL_WIDTH, &TRAIL_HEIGHT) != 2 || TRAIL_WIDTH == 0 || TRAIL_HEIGHT == 0)
+            {
+                std::cerr << "Expected --trail-size WIDTHxHEIGHT" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--diffuse-tile") == 0)
+        {
+            if (sscanf(value, "%ux%u", &opts.diffuseTile.x, &opts.diffuseTile.y) != 2)
+            {
+                std::cerr << "Expected --diffuse-tile WIDTHxHEIGHT" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--agent-precision") == 0)
+        {
+            if (strcmp(value, "float") == 0) opts.precision = agentPrecision::FLOAT32;
+            else if (strcmp(value, "fixed16") == 0) opts.precision = agentPrecision::FIXED16;
+            else
+            {
+                std::cerr << "Expected --agent-precision float|fixed16" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--agent-kernel") == 0)
+        {
+            if (strcmp(value, "auto") == 0) opts.kernel = agentKernelType::AUTO;
+            else if (strcmp(value, "scalar") == 0) opts.kernel = agentKernelType::SCALAR;
+            else if (strcmp(value, "avx2") == 0) opts.kernel = agentKernelType::AVX2;
+            else if (strcmp(value, "avx512") == 0) opts.kernel = agentKernelType::AVX512;
+            else
+            {
+                std::cerr << "Expected --agent-kernel auto|scalar|avx2|avx512" << std::endl;
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--spawn") == 0)
+        {
+            if (strcmp(value, "in") == 0) generation = generationType::IN_CIRCLE;
+            else if (strcmp(value, "out") == 0) generation = generationType::OUT_CIRCLE;
+            else if (strcmp(value, "random") == 0) generation = generationType::RANDOM;
+            else
+            {
+                std::cerr << "Expected --spawn in|out|random" << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << argument << std::endl;
+            return false;
+        }
+    }
+
+    // Whichever order the arguments came in
+    if (!spawnRadiusGiven)
+        SPAWN_RADIUS = TRAIL_HEIGHT / 2;
+
+    if (opts.headless && opts.backend == backendType::GPU)
+        std::cerr << "Headless mode has no OpenGL context, using the CPU backend" << std::endl;
+
+    return true;
+}
+
+// Runs the CPU simulation with a fixed timestep and writes trail snapshots, without creating a window
+int runHeadless(const options& opts, ThreadPool& pool)
+{
+    // Checked before simulating, rather than failing at the first snapshot
+    std::error_code error;
+    std::filesystem::create_directories(opts.outputDirectory, error);
+    if (error || !std::filesystem::is_directory(opts.outputDirectory, error))
+    {
+        std::cerr << "ERROR::SNAPSHOT: Unable to create output directory " << opts.outputDirectory
+            << (error ? ": " + error.message() : "") << std::endl;
+        return 1;
+    }
+
+    CpuSimulation simulation(pool, TRAIL_WIDTH, TRAIL_HEIGHT);
+    simulation.setAgentPrecision(opts.precision);
+    simulation.setAgentKernel(opts.kernel);
+    simulation.setDiffuseTileSize(opts.diffuseTile.x, opts.diffuseTile.y);
+    simulation.spawnAgents(getSpawnSettings(), AGENT_COUNT);
+    simulation.clearTrail();
+
+    SimulationSettings settings = getSettings();
+
+    std::cout << "Simulating " << AGENT_COUNT << " agents on a " << TRAIL_WIDTH << "x" << TRAIL_HEIGHT << " trail map for " << opts.steps << " steps on "
+        << simulation.getThreadCount() << " threads, " << simulation.getAgents().getBytesPerAgent() << " bytes per agent, "
+        << getAgentKernelName(simulation.getAgentKernel()) << " agent kernel" << std::endl;
+
+    double simulationTime = 0.0;
+    double agentPassTime = 0.0;
+    double sortTime = 0.0;
+    int sorts = 0;
+    for (int step = 1; step <= opts.steps; step++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        simulation.step(settings, opts.timestep);
+        simulationTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        agentPassTime += simulation.getAgentPassSeconds();
+        if (SORT_INTERVAL > 0 && (step - 1) % SORT_INTERVAL == 0)
+        {
+            sortTime += simulation.getSortSeconds();
+            sorts++;
+        }
+
+        bool lastStep = step == opts.steps;
+        if (lastStep || (opts.snapshotInterval > 0 && step % opts.snapshotInterval == 0))
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%06d.ppm", step);
+            if (!writeSnapshot(opts.outputDirectory + name, simulation.getWidth(), simulation.getHeight(), simulation.getTrail(), opts.colour))
+                return 1;
+        }
+    }
+
+    std::cout << "State checksum after step " << simulation.getStepCount() << ": " << std::hex << simulation.getChecksum() << std::dec << std::endl;
+
+    if (simulationTime > 0.0)
+    {
+        std::cout << "Steps per second: " << opts.steps / simulationTime << std::endl;
+        std::cout << "Agent steps per second: " << (double)AGENT_COUNT * opts.steps / simulationTime << std::endl;
+    }
+
+    if (sorts > 0)
+        std::cout << "Agent sort: " << sortTime / sorts * 1e3 << " ms every " << SORT_INTERVAL << " steps" << std::endl;
+
+    if (agentPassTime > 0.0)
+    {
+        double bandwidth = measureMemoryBandwidth(pool);
+        double bytesPerAgent = simulation.getBytesPerAgentStep();
+        double agentRate = (double)AGENT_COUNT * opts.steps / agentPassTime;
+        double roofline = agentRoofline(bandwidth, bytesPerAgent);
+
+        std::cout << "Agent pass: " << agentRate / 1e6 << " M agent steps/s, " << bytesPerAgent << " bytes/agent, "
+            << agentRate * bytesPerAgent / 1e9 << " GB/s" << std::endl;
+        std::cout << "Roofline at " << bandwidth / 1e9 << " GB/s measured: " << roofline / 1e6 << " M agent steps/s ("
+            << 100.0 * agentRate / roofline << "% reached)" << std::endl;
+    }
+
+    return 0;
 }
 
 void resetValues()
 {
     DECAY_AMOUNT = DEFAULT_DECAY_AMOUNT;
     DIFFUSE_SPEED = DEFAULT_DIFFUSE_SPEED;
+    DIFFUSE_RADIUS = DEFAULT_DIFFUSE_RADIUS;
+    DEPOSIT_AMOUNT = DEFAULT_DEPOSIT_AMOUNT;
     MOVEMENT_DISTANCE = DEFAULT_MOVEMENT_DISTANCE;
     SENSOR_DISTANCE = DEFAULT_SENSOR_DISTANCE;
     SENSOR_ANGLE = DEFAULT_SENSOR_ANGLE;
     ROTATION = DEFAULT_ROTATION;
-    SPAWN_RADIUS = DEFAULT_SPAWN_RADIUS;
+    SPAWN_RADIUS = TRAIL_HEIGHT / 2;
     AGENT_COUNT = DEFAULT_AGENT_COUNT;
+    SORT_INTERVAL = DEFAULT_SORT_INTERVAL;
 }
 
-void reset(unsigned int ssbo, unsigned int fbo, unsigned int texture)
+// Spawns straight into the backend's own agent storage, reusing it when the agent count has not grown
+void reset(SimulationBackend& backend, ThreadPool& pool)
 {
-    std::vector<agent> agents;
-    for (int i = 0; i < AGENT_COUNT; i++)
-    {
-        agent a;
-        switch (generation)
-        {
-        case generationType::IN_CIRCLE: a = generateInwardCircle(SPAWN_RADIUS); break;
-        case generationType::OUT_CIRCLE: a = generateOutwardCircle(SPAWN_RADIUS); break;
-        case generationType::RANDOM: a = generateRandom(); break;
-        }
-        
-        agents.push_back(a);
-    }
+    backend.spawn(pool, getSpawnSettings(), AGENT_COUNT);
+}
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, agents.size() * sizeof(agent), &agents[0], GL_DYNAMIC_DRAW);
+SpawnSettings getSpawnSettings()
+{
+    SpawnSettings settings;
+    settings.type = generation;
+    settings.radius = (float)SPAWN_RADIUS;
+    settings.width = TRAIL_WIDTH;
+    settings.height = TRAIL_HEIGHT;
+    settings.seed = SEED;
+    return settings;
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+SimulationSettings getSettings()
+{
+    SimulationSettings settings;
+    settings.decayAmount = DECAY_AMOUNT;
+    settings.diffuseSpeed = DIFFUSE_SPEED;
+    settings.diffuseRadius = DIFFUSE_RADIUS;
+    settings.movementDistance = MOVEMENT_DISTANCE;
+    settings.sensorDistance = SENSOR_DISTANCE;
+    settings.sensorAngle = SENSOR_ANGLE;
+    settings.rotationAngle = ROTATION;
+    settings.deposit = DEPOSIT_MODE;
+    settings.depositAmount = DEPOSIT_AMOUNT;
+    settings.seed = SEED;
+    settings.sortInterval = SORT_INTERVAL;
+    return settings;
 }
 
-agent generateInwardCircle(int maxRadius)
+// Times the agent pass alone at each power of two workgroup size, then restores the current one
+std::vector<groupSizeResult> measureAgentGroupSizes(GpuBackend& backend, const SimulationSettings& settings, float timestep)
 {
-    int radius = rand() % maxRadius;
-    float angle = (rand() % (360 * 30)) / 30.0f;
+    const int warmupSteps = 3;
+    const int timedSteps = 20;
 
-    agent a;
-    a.pos = glm::vec3(0.0f);
-    a.pos.x = (TEXTURE_WIDTH  / 2) + (radius * cos(degToRad(angle)));
-    a.pos.y = (TEXTURE_HEIGHT / 2) + (radius * sin(degToRad(angle)));
-    a.pos.z = 0.0;
+    std::vector<groupSizeResult> results;
+    unsigned int previous = backend.getAgentGroupSize();
 
-    a.angle = angle + 180.0;
+    for (unsigned int size = 32; size <= 1024; size *= 2)
+    {
+        backend.setAgentGroupSize(size);
+        if (backend.getAgentGroupSize() != size)
+            break;
+
+        for (int i = 0; i < warmupSteps; i++)
+            backend.stepAgents(settings, timestep);
+        backend.finish();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < timedSteps; i++)
+            backend.stepAgents(settings, timestep);
+        backend.finish();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        groupSizeResult result;
+        result.groupSize = size;
+        result.agentsPerSecond = (double)backend.getAgentCount() * timedSteps / elapsed;
+        results.push_back(result);
+
+        std::cout << "Agent group size " << size << ": " << result.agentsPerSecond / 1e6 << " M agents/s" << std::endl;
+    }
 
-    return a;
+    backend.setAgentGroupSize(previous);
+    return results;
 }
 
-agent generateOutwardCircle(int maxRadius)
+// A rolling histogram of the last frames for each pass, with its average and worst frame
+void drawPassTimings(const Profiler& profiler)
 {
-    int radius = rand() % maxRadius;
-    float angle = (rand() % (360 * 30)) / 30.0f;
+    for (const Profiler::passHistory& pass : profiler.getPasses())
+    {
+        if (pass.count == 0)
+            continue;
+
+        float total = 0.0f, highest = 0.0f;
+        for (int i = 0; i < pass.count; i++)
+        {
+            total += pass.milliseconds[i];
+            highest = std::max(highest, pass.milliseconds[i]);
+        }
 
-    agent a;
-    a.pos = glm::vec3(0.0f);
-    a.pos.x = (TEXTURE_WIDTH  / 2) + (radius * cos(degToRad(angle)));
-    a.pos.y = (TEXTURE_HEIGHT / 2) + (radius * sin(degToRad(angle)));
-    a.pos.z = 0.0;
+        std::string label = pass.name + (pass.clock == timerClock::GPU ? " (GPU)" : " (CPU)");
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.2f ms average, %.2f ms max", total / pass.count, highest);
 
-    a.angle = angle;
+        // Until the ring is full the oldest frame is at the start
+        int offset = pass.count == Profiler::HISTORY ? pass.next : 0;
+        ImGui::Text("%s", label.c_str());
+        ImGui::PlotHistogram(("##" + label).c_str(), pass.milliseconds.data(), pass.count, offset, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+    }
 
-    return a;
+    if (profiler.getDroppedFrames() > 0)
+        ImGui::Text("GPU timings dropped for %u frames that had not finished", profiler.getDroppedFrames());
 }
 
-agent generateRandom()
+// Prints why when the size is too large
+bool isTrailSizeSupported(glm::uvec2 size, glm::uvec2 maxSize)
 {
-    agent a;
-    a.pos = glm::vec3(rand() % TEXTURE_WIDTH, rand() % TEXTURE_HEIGHT, 0.0);
-    a.angle = rand() % 360;
-    return a;
+    if (size.x <= maxSize.x && size.y <= maxSize.y)
+        return true;
+
+    std::cerr << "ERROR::TRAIL: " << size.x << "x" << size.y << " trail map is larger than the "
+        << maxSize.x << "x" << maxSize.y << " the driver supports" << std::endl;
+    return false;
 }
@@ -0,0 +1,347 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <GLAD/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class timerClock
+{
+    // steady_clock time on the host
+    CPU,
+    // GL_TIME_ELAPSED of the commands issued between the start and end of a scope
+    GPU
+};
+
+// Per pass timings of the last HISTORY frames, and the scopes they came from for a
+// Chrome trace. GPU scopes are timed with GL_TIME_ELAPSED queries, plus a GL_TIMESTAMP
+// at their start to place them in the trace. Each frame's queries go into one set of a
+// ring of FRAMES_IN_FLIGHT, read back when the ring comes round to that set again. By
+// then the GPU has normally finished them, and a set that is still not ready is
+// dropped rather than waited for, so reading timings never stalls the pipeline.
+class Profiler
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    static constexpr int HISTORY = 240;
+
+    struct passHistory
+    {
+        std::string name;
+        timerClock clock;
+        // Milliseconds spent in the pass each frame, oldest at next once the ring is full
+        std::array<float, HISTORY> milliseconds {};
+        int next = 0;
+        int count = 0;
+        // Seconds so far in the frame being recorded
+        double frameTotal = 0.0;
+    };
+private:
+    struct traceEvent
+    {
+        unsigned int pass;
+        // Nanoseconds on the steady_clock
+        int64_t start, duration;
+        uint64_t frame;
+        // Main thread scopes share a track. Pass ranges from the simulation's threads
+        // overlap each other, so each gets its own.
+        bool ownTrack;
+    };
+
+    struct gpuQuery
+    {
+        unsigned int pass;
+        unsigned int timestamp, elapsed;
+    };
+
+    struct frameQueries
+    {
+        std::vector<gpuQuery> queries;
+        size_t used = 0;
+        uint64_t frame = 0;
+        bool pending = false;
+    };
+
+    std::array<frameQueries, FRAMES_IN_FLIGHT> frames;
+    uint64_t frame = 0;
+    // GL_TIME_ELAPSED queries cannot nest
+    bool gpuScopeOpen = false;
+
+    // Added to a GL_TIMESTAMP to give steady_clock time
+    int64_t gpuClockOffset;
+    int64_t startTime;
+
+    std::vector<passHistory> passes;
+    std::deque<traceEvent> trace;
+    unsigned int droppedFrames = 0;
+public:
+    // Needs a current OpenGL context, which it has to be destroyed before
+    Profiler()
+    {
+        GLint64 gpuTime;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        startTime = now();
+        gpuClockOffset = startTime - gpuTime;
+    }
+
+    ~Profiler()
+    {
+        for (frameQueries& queries : frames)
+        {
+            for (gpuQuery& query : queries.queries)
+            {
+                glDeleteQueries(1, &query.timestamp);
+                glDeleteQueries(1, &query.elapsed);
+            }
+        }
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void beginFrame()
+    {
+        frame++;
+        frameQueries& queries = frames[frame % FRAMES_IN_FLIGHT];
+        collect(queries, false);
+        queries.used = 0;
+        queries.frame = frame;
+    }
+
+    void endFrame()
+    {
+        frameQueries& queries = frames[frame % FRAMES_IN_FLIGHT];
+        queries.pending = queries.used > 0;
+
+        pushFrame(timerClock::CPU);
+
+        // GPU scopes arrive a few frames late, so the trace is only roughly in frame order
+        while (!trace.empty() && trace.front().frame + HISTORY <= frame)
+            trace.pop_front();
+    }
+
+    // Waits for and reads back every outstanding query, for when timings are wanted straight away
+    void flush()
+    {
+        for (int i = 1; i <= FRAMES_IN_FLIGHT; i++)
+            collect(frames[(frame + i) % FRAMES_IN_FLIGHT], true);
+    }
+
+    // Times nothing and returns false while another GPU scope is open
+    bool beginGpu(const char* name)
+    {
+        if (gpuScopeOpen)
+            return false;
+
+        frameQueries& queries = frames[frame % FRAMES_IN_FLIGHT];
+        if (queries.used == queries.queries.size())
+        {
+            gpuQuery query;
+            glGenQueries(1, &query.timestamp);
+            glGenQueries(1, &query.elapsed);
+            queries.queries.push_back(query);
+        }
+
+        gpuQuery& query = queries.queries[queries.used++];
+        query.pass = getPass(name, timerClock::GPU);
+        glQueryCounter(query.timestamp, GL_TIMESTAMP);
+        glBeginQuery(GL_TIME_ELAPSED, query.elapsed);
+
+        gpuScopeOpen = true;
+        return true;
+    }
+
+    void endGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuScopeOpen = false;
+    }
+
+    // A scope on the calling thread, from steady_clock times
+    void addCpu(const char* name, int64_t start, int64_t end)
+    {
+        addCpu(name, start, end, false);
+    }
+
+    // Time from the first to the last task of a pass that ran across the simulation's
+    // threads, which may overlap other passes
+    void addCpuRange(const char* name, int64_t start, int64_t end)
+    {
+        addCpu(name, start, end, true);
+    }
+
+    const std::vector<passHistory>& getPasses() const { return passes; }
+    unsigned int getDroppedFrames() const { return droppedFrames; }
+
+    // Every scope of the frames still in the history, in the Trace Event Format read by
+    // chrome://tracing and Perfetto
+    bool writeChromeTrace(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+
+        const unsigned int mainTrack = 1;
+        const unsigned int gpuTrack = 2;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << mainTrack << ",\"args\":{\"name\":\"Main thread\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuTrack << ",\"args\":{\"name\":\"GPU\"}}";
+
+        std::vector<bool> ownTracks(passes.size(), false);
+        for (const traceEvent& event : trace)
+            ownTracks[event.pass] = ownTracks[event.pass] || event.ownTrack;
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (ownTracks[i])
+            {
+                file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 3 + i
+                    << ",\"args\":{\"name\":\"" << passes[i].name << " (simulation threads)\"}}";
+            }
+        }
+
+        file.setf(std::ios::fixed);
+        file.precision(3);
+        for (const traceEvent& event : trace)
+        {
+            const passHistory& pass = passes[event.pass];
+            unsigned int track = pass.clock == timerClock::GPU ? gpuTrack : (event.ownTrack ? 3 + event.pass : mainTrack);
+
+            file << ",\n{\"name\":\"" << pass.name << "\",\"cat\":\"" << (pass.clock == timerClock::GPU ? "GPU" : "CPU")
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+                << ",\"ts\":" << (event.start - startTime) * 1e-3 << ",\"dur\":" << event.duration * 1e-3
+                << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+        file << "\n]}\n";
+
+        return (bool)file;
+    }
+private:
+    unsigned int getPass(const char* name, timerClock clock)
+    {
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (passes[i].clock == clock && passes[i].name == name)
+                return (unsigned int)i;
+        }
+
+        passHistory pass;
+        pass.name = name;
+        pass.clock = clock;
+        passes.push_back(pass);
+        return (unsigned int)passes.size() - 1;
+    }
+
+    void addCpu(const char* name, int64_t start, int64_t end, bool ownTrack)
+    {
+        unsigned int pass = getPass(name, timerClock::CPU);
+        passes[pass].frameTotal += (end - start) * 1e-9;
+        trace.push_back({ pass, start, end - start, frame, ownTrack });
+    }
+
+    // Records every pass of the clock for a frame, so passes that did not run show as 0
+    void pushFrame(timerClock clock)
+    {
+        for (passHistory& pass : passes)
+        {
+            if (pass.clock != clock)
+                continue;
+
+            pass.milliseconds[pass.next] = (float)(pass.frameTotal * 1e3);
+            pass.next = (pass.next + 1) % HISTORY;
+            pass.count = std::min(pass.count + 1, HISTORY);
+            pass.frameTotal = 0.0;
+        }
+    }
+
+    void collect(frameQueries& queries, bool wait)
+    {
+        if (!queries.pending)
+            return;
+        queries.pending = false;
+
+        // Queries finish in order, so once the last is available the rest are too
+        if (!wait)
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries.queries[queries.used - 1].elapsed, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                droppedFrames++;
+                return;
+            }
+        }
+
+        for (size_t i = 0; i < queries.used; i++)
+        {
+            const gpuQuery& query = queries.queries[i];
+            GLuint64 timestamp, elapsed;
+            glGetQueryObjectui64v(query.timestamp, GL_QUERY_RESULT, &timestamp);
+            glGetQueryObjectui64v(query.elapsed, GL_QUERY_RESULT, &elapsed);
+
+            passes[query.pass].frameTotal += elapsed * 1e-9;
+            trace.push_back({ query.pass, (int64_t)timestamp + gpuClockOffset, (int64_t)elapsed, queries.frame, false });
+        }
+
+        pushFrame(timerClock::GPU);
+    }
+};
+
+// Times the enclosing block on the GPU, when there is a profiler
+class GpuTimerScope
+{
+private:
+    Profiler* profiler;
+    bool open;
+public:
+    GpuTimerScope(Profiler* profiler, const char* name)
+        : profiler(profiler), open(profiler && profiler->beginGpu(name))
+    {
+    }
+
+    ~GpuTimerScope()
+    {
+        if (open)
+            profiler->endGpu();
+    }
+
+    GpuTimerScope(const GpuTimerScope&) = delete;
+    GpuTimerScope& operator=(const GpuTimerScope&) = delete;
+};
+
+// Times the enclosing block on the host, when there is a profiler
+class CpuTimerScope
+{
+private:
+    Profiler* profiler;
+    const char* name;
+    int64_t start;
+public:
+    CpuTimerScope(Profiler* profiler, const char* name)
+        : profiler(profiler), name(name), start(Profiler::now())
+    {
+    }
+
+    ~CpuTimerScope()
+    {
+        if (profiler)
+            profiler->addCpu(name, start, Profiler::now());
+    }
+
+    CpuTimerScope(const CpuTimerScope&) = delete;
+    CpuTimerScope& operator=(const CpuTimerScope&) = delete;
+};
+
+#endif
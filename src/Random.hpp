@@ -0,0 +1,47 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+// Philox2x32-10 counter based generator (Salmon et al. 2011). Every output is
+// a pure function of the counter and the key, so any number of threads can
+// draw from independent streams without sharing state.
+//
+// res/Shaders/random.glsl is the same generator for the compute shaders and
+// must be kept bit-identical to this file.
+
+// XORed into the seed so each consumer draws from its own stream
+const uint32_t RANDOM_STREAM_SPAWN = 0x00000000u;
+const uint32_t RANDOM_STREAM_AGENT = 0x1B873593u;
+
+struct philox2x32
+{
+    uint32_t x, y;
+};
+
+inline philox2x32 philox(uint32_t counter0, uint32_t counter1, uint32_t key)
+{
+    const uint32_t multiplier = 0xD256D193u;
+    const uint32_t weyl = 0x9E3779B9u;
+
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t product = (uint64_t)multiplier * counter0;
+        uint32_t hi = (uint32_t)(product >> 32);
+        uint32_t lo = (uint32_t)product;
+
+        counter0 = hi ^ key ^ counter1;
+        counter1 = lo;
+        key += weyl;
+    }
+
+    return { counter0, counter1 };
+}
+
+// Uniform float in [0, 1) using the top 24 bits, so it is exact in single precision
+inline float uniformFloat(uint32_t bits)
+{
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef ROOFLINE_HPP
+#define ROOFLINE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+// STREAM style triad a = b + s * c over buffers much larger than the caches, on every
+// thread of the pool. Returns the best of a few runs in bytes per second, counting
+// two loads and one store per element and ignoring write allocation.
+inline double measureMemoryBandwidth(ThreadPool& pool, size_t elements = (size_t)1 << 23, int repeats = 4)
+{
+    std::vector<float> a(elements), b(elements, 1.0f), c(elements, 2.0f);
+    const float scale = 3.0f;
+
+    double best = 0.0;
+    for (int run = 0; run <= repeats; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        pool.parallelFor(elements, 1 << 16, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                a[i] = b[i] + scale * c[i];
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // The first run also pays for page faults
+        if (run > 0 && seconds > 0.0)
+            best = std::max(best, 3.0 * sizeof(float) * elements / seconds);
+    }
+
+    return best;
+}
+
+// Memory bound ceiling on agent steps per second, given the traffic each one needs
+inline double agentRoofline(double bytesPerSecond, double bytesPerAgent)
+{
+    return bytesPerAgent > 0.0 ? bytesPerSecond / bytesPerAgent : 0.0;
+}
+
+#endif
@@ -7,97 +7,96 @@
 #include <GLM/gtc/matrix_transform.hpp>
 #include <GLM/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <filesystem>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include "ShaderCache.hpp"
+
 class Shader
 {
 public:
     unsigned int ID;
+protected:
+    struct storageBlock
+    {
+        std::string name;
+        unsigned int index;
+        int binding;
+    };
+
+    // Read once after linking, so setting a uniform or binding a buffer by name does
+    // not go through the driver's name lookup. A program has a handful of each, so a
+    // linear search is cheaper than hashing the name.
+    std::vector<std::pair<std::string, int>> uniformLocations;
+    std::vector<storageBlock> storageBlocks;
+
+    // Every file read by the last compileFromPath, includes too, for hot reloading
+    std::vector<std::string> sourceFiles;
+private:
+    std::string vertexPath, fragmentPath, geometryPath;
 public:
     Shader() {}
 
-    void compileFromPath(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // Returns false and leaves ID 0 if the program does not link
+    bool compileFromPath(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-
-        std::ifstream file;
-        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-        try
-        {
-            std::stringstream vertexStream, fragmentStream, geometryStream;
-            
-            file.open(vertexPath);
-            vertexStream << file.rdbuf();
-            file.close();
-            vertexCode = vertexStream.str();
-
-            file.open(fragmentPath);
-            fragmentStream << file.rdbuf();
-            file.close();
-            fragmentCode = fragmentStream.str();
-
-            if (geometryPath)
-            {
-                file.open(geometryPath);
-                geometryStream << file.rdbuf();
-                file.close();
-                geometryCode = geometryStream.str();
-            }
-        }
-        catch (std::ifstream::failure* e)
-        {
-            std::cerr << "ERROR:SHADER::FILE_READ_ERROR" << std::endl;
-        }
-
-        const char* vertexSource = vertexCode.c_str();
-        const char* fragmentSource = fragmentCode.c_str();
-        const char* geometrySource = geometryCode.c_str();
+        this->vertexPath = vertexPath;
+        this->fragmentPath = fragmentPath;
+        this->geometryPath = geometryPath ? geometryPath : "";
 
-        unsigned int sVertex, sFragment, gShader;
+        sourceFiles.clear();
+        std::string vertexCode = readSource(vertexPath, &sourceFiles);
+        std::string fragmentCode = readSource(fragmentPath, &sourceFiles);
+        std::string geometryCode = geometryPath ? readSource(geometryPath, &sourceFiles) : "";
 
-        // Vertex Shader
-        sVertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(sVertex, 1, &vertexSource, NULL);
-        glCompileShader(sVertex);
-        checkCompileErrors(sVertex, "VERTEX");
+        return compileFromSource(vertexCode.c_str(), fragmentCode.c_str(), geometryPath ? geometryCode.c_str() : nullptr);
+    }
 
-        // Fragment Shader
-        sFragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(sFragment, 1, &fragmentSource, NULL);
-        glCompileShader(sFragment);
-        checkCompileErrors(sFragment, "FRAGMENT");
+    // Compiles the files from the last compileFromPath into a new program, overwriting ID
+    // without deleting the old one, see reloadShader
+    bool compileAgain()
+    {
+        return compileFromPath(vertexPath.c_str(), fragmentPath.c_str(), geometryPath.empty() ? nullptr : geometryPath.c_str());
+    }
 
-        // Geometry Shader
-        if (geometryPath)
+    // Whether any of the files, normalised with normalisePath, went into the program
+    bool usesAnyOf(const std::vector<std::string>& files) const
+    {
+        for (const std::string& file : files)
         {
-            gShader = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(gShader, 1, &geometrySource, NULL);
-            glCompileShader(gShader);
-            checkCompileErrors(gShader, "GEOMETRY");
+            if (std::find(sourceFiles.begin(), sourceFiles.end(), file) != sourceFiles.end())
+                return true;
         }
+        return false;
+    }
 
-        // Create the Shader
-        ID = glCreateProgram();
-        glAttachShader(ID, sVertex);
-        glAttachShader(ID, sFragment);
-        if (geometryPath) glAttachShader(ID, gShader);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-
-        // Delete the Shaders
-        glDeleteShader(sVertex);
-        glDeleteShader(sFragment);
-        if (geometryPath) glDeleteShader(gShader);
+    static std::string normalisePath(const std::string& path)
+    {
+        return std::filesystem::path(path).lexically_normal().generic_string();
     }
 
-    void compileFromSource(const char* vertexSource, const char* fragmentSource, const char* geometrySource = nullptr)
+    // Returns false and leaves ID 0 if the program does not link
+    bool compileFromSource(const char* vertexSource, const char* fragmentSource, const char* geometrySource = nullptr)
     {
+        std::string vertexCode = vertexSource;
+        std::string fragmentCode = fragmentSource;
+        std::string geometryCode = geometrySource ? geometrySource : "";
+
+        std::string key = ShaderCache::getKey({ &vertexCode, &fragmentCode, geometrySource ? &geometryCode : nullptr });
+        ID = ShaderCache::load(key);
+        if (ID)
+        {
+            reflect();
+            return true;
+        }
+
         unsigned int sVertex, sFragment, gShader;
 
         // Vertex Shader
@@ -126,46 +125,167 @@ public:
         glAttachShader(ID, sVertex);
         glAttachShader(ID, sFragment);
         if (geometrySource) glAttachShader(ID, gShader);
+        ShaderCache::prepare(ID, key);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        bool linked = checkCompileErrors(ID, "PROGRAM");
+        ShaderCache::store(ID, key);
+        reflect();
 
         // Delete the Shaders
         glDeleteShader(sVertex);
         glDeleteShader(sFragment);
         if (geometrySource) glDeleteShader(gShader);
+
+        return keepIfLinked(linked);
     }
 
     Shader& use() { glUseProgram(ID); return *this; }
 
+    // -1 for uniforms the program does not use, which glUniform ignores
+    int getUniformLocation(const char* name) const
+    {
+        for (const auto& uniform : uniformLocations)
+        {
+            if (uniform.first == name)
+                return uniform.second;
+        }
+        return -1;
+    }
+
     void setFloat(const char* name, float value, bool useShader = false) 
-        { if(useShader) use(); glUniform1f(glGetUniformLocation(ID, name), value); }
+        { if(useShader) use(); glUniform1f(getUniformLocation(name), value); }
     
     void setInt(const char* name, int value, bool useShader = false) 
-        { if(useShader) use(); glUniform1i(glGetUniformLocation(ID, name), value); }
+        { if(useShader) use(); glUniform1i(getUniformLocation(name), value); }
+    
+    void setUnsignedInt(const char* name, unsigned int value, bool useShader = false)
+        { if(useShader) use(); glUniform1ui(getUniformLocation(name), value); }
     
     void setVector2f(const char* name, float x, float y, bool useShader = false)
-        { if(useShader) use(); glUniform2f(glGetUniformLocation(ID, name), x, y); }
+        { if(useShader) use(); glUniform2f(getUniformLocation(name), x, y); }
     
     void setVector2f(const char* name, const glm::vec2& value, bool useShader = false)
-        { if(useShader) use(); glUniform2f(glGetUniformLocation(ID, name), value.x, value.y); }
+        { if(useShader) use(); glUniform2f(getUniformLocation(name), value.x, value.y); }
     
     void setVector3f(const char* name, float x, float y, float z, bool useShader = false)
-        { if(useShader) use(); glUniform3f(glGetUniformLocation(ID, name), x, y, z); }
+        { if(useShader) use(); glUniform3f(getUniformLocation(name), x, y, z); }
     
     void setVector3f(const char* name, const glm::vec3& value, bool useShader = false)
-        { if(useShader) use(); glUniform3f(glGetUniformLocation(ID, name), value.x, value.y, value.z); }
+        { if(useShader) use(); glUniform3f(getUniformLocation(name), value.x, value.y, value.z); }
     
     void setVector4f(const char* name, float x, float y, float z, float w, bool useShader = false)
-        { if(useShader) use(); glUniform4f(glGetUniformLocation(ID, name), x, y, z, w); }
+        { if(useShader) use(); glUniform4f(getUniformLocation(name), x, y, z, w); }
     
     void setVector4f(const char* name, const glm::vec4& value, bool useShader = false)
-        { if(useShader) use(); glUniform4f(glGetUniformLocation(ID, name), value.x, value.y, value.z, value.w); }
+        { if(useShader) use(); glUniform4f(getUniformLocation(name), value.x, value.y, value.z, value.w); }
     
     void setMatrix4(const char* name, glm::mat4 matrix, bool useShader = false)
-        { if(useShader) use(); glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, false, glm::value_ptr(matrix)); }
+        { if(useShader) use(); glUniformMatrix4fv(getUniformLocation(name), 1, false, glm::value_ptr(matrix)); }
 
 protected:
-    void checkCompileErrors(unsigned int object, std::string type)
+    // Reads a shader file, replacing `#include "file"` lines with that file relative to the includer
+    static std::string readSource(const std::string& path, std::vector<std::string>* files = nullptr)
+    {
+        if (files)
+            files->push_back(normalisePath(path));
+
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "ERROR:SHADER::FILE_READ_ERROR: " << path << std::endl;
+            return "";
+        }
+
+        std::string directory;
+        size_t slash = path.find_last_of("/\\");
+        if (slash != std::string::npos)
+            directory = path.substr(0, slash + 1);
+
+        std::stringstream source;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t open = line.find("#include \"");
+            size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 10);
+            if (close != std::string::npos)
+                source << readSource(directory + line.substr(open + 10, close - open - 10), files) << "\n";
+            else
+                source << line << "\n";
+        }
+
+        return source.str();
+    }
+
+    static std::string insertAfterVersion(const std::string& source, const std::string& text)
+    {
+        if (text.empty())
+            return source;
+
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return text + "\n" + source;
+
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + text + "\n";
+
+        return source.substr(0, lineEnd + 1) + text + "\n" + source.substr(lineEnd + 1);
+    }
+
+    void reflect()
+    {
+        uniformLocations.clear();
+        storageBlocks.clear();
+
+        char name[256];
+        int count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for (int i = 0; i < count; i++)
+        {
+            int size;
+            GLenum type;
+            glGetActiveUniform(ID, i, sizeof(name), NULL, &size, &type, name);
+
+            // Members of uniform blocks have no location
+            int location = glGetUniformLocation(ID, name);
+            if (location < 0)
+                continue;
+
+            // Arrays are reported as name[0], and set by their plain name
+            std::string uniform = name;
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+                uniform.resize(uniform.size() - 3);
+            uniformLocations.emplace_back(uniform, location);
+        }
+
+        // Storage blocks can only be listed with the 4.3 program interface queries
+        if (!GLAD_GL_ARB_program_interface_query)
+            return;
+
+        glGetProgramInterfaceiv(ID, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &count);
+        for (int i = 0; i < count; i++)
+        {
+            glGetProgramResourceName(ID, GL_SHADER_STORAGE_BLOCK, i, sizeof(name), NULL, name);
+
+            const GLenum property = GL_BUFFER_BINDING;
+            int binding;
+            glGetProgramResourceiv(ID, GL_SHADER_STORAGE_BLOCK, i, 1, &property, 1, NULL, &binding);
+            storageBlocks.push_back({ name, (unsigned int)i, binding });
+        }
+    }
+
+    // A program that failed to link is deleted, so ID never names an unusable program
+    bool keepIfLinked(bool linked)
+    {
+        if (!linked)
+        {
+            glDeleteProgram(ID);
+            ID = 0;
+        }
+        return linked;
+    }
+
+    bool checkCompileErrors(unsigned int object, std::string type)
     {
         int success;
         char infoLog[1024];
@@ -187,37 +307,46 @@ protected:
                 std::cerr << "| ERROR::SHADER: Link-time Error: Type: " << type << "\n" << infoLog << std::endl << std::endl;
             }
         }
+        return success;
     }
 };
 
 class ComputeShader : public Shader
 {
+private:
+    std::string computePath, defines;
 public:
     ComputeShader() {}
 
-    void compileFromPath(const char* computePath)
+    // defines is inserted after the #version line, for values fixed at compile time such as workgroup sizes
+    bool compileFromPath(const char* computePath, const std::string& defines = "")
     {
-        std::string computeCode;
+        this->computePath = computePath;
+        this->defines = defines;
 
-        std::ifstream file;
-        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        sourceFiles.clear();
+        std::string computeCode = insertAfterVersion(readSource(computePath, &sourceFiles), defines);
+        return compileFromSource(computeCode.c_str());
+    }
 
-        try
-        {
-            std::stringstream computeStream;
-            
-            file.open(computePath);
-            computeStream << file.rdbuf();
-            file.close();
-            computeCode = computeStream.str();
-        }
-        catch (std::ifstream::failure* e)
+    // See Shader::compileAgain
+    bool compileAgain()
+    {
+        return compileFromPath(computePath.c_str(), defines);
+    }
+
+    // Returns false and leaves ID 0 if the program does not link
+    bool compileFromSource(const char* computeSource)
+    {
+        std::string computeCode = computeSource;
+        std::string key = ShaderCache::getKey({ &computeCode });
+        ID = ShaderCache::load(key);
+        if (ID)
         {
-            std::cerr << "ERROR:SHADER::FILE_READ_ERROR" << std::endl;
+            reflect();
+            return true;
         }
 
-        const char* computeSource = computeCode.c_str();
-
         unsigned int sCompute;
 
         // Compute Shader
@@ -229,39 +358,93 @@ public:
         // Create the Shader
         ID = glCreateProgram();
         glAttachShader(ID, sCompute);
+        ShaderCache::prepare(ID, key);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        bool linked = checkCompileErrors(ID, "PROGRAM");
+        ShaderCache::store(ID, key);
+        reflect();
 
         // Delete the Shaders
         glDeleteShader(sCompute);
+
+        return keepIfLinked(linked);
     }
 
-    void compileFromSource(const char* computeSource)
+    // Binds the buffer to the block's binding point. Only changes the block's binding
+    // when it differs from the one it already has.
+    void addStorageBuffer(const char* name, int binding, unsigned int ssbo)
     {
-        unsigned int sCompute;
+        for (storageBlock& block : storageBlocks)
+        {
+            if (block.name == name && block.binding != binding)
+            {
+                glShaderStorageBlockBinding(ID, block.index, binding);
+                block.binding = binding;
+            }
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
+    }
+};
 
-        // Compute Shader
-        sCompute = glCreateShader(GL_COMPUTE_SHADER);
-        glShaderSource(sCompute, 1, &computeSource, NULL);
-        glCompileShader(sCompute);
-        checkCompileErrors(sCompute, "COMPUTE");
+// One compute shader file compiled with different defines, such as a constant in place
+// of a uniform so the compiler can fold it. Each variant is compiled the first time
+// it is asked for and kept, keyed by its defines.
+class ComputeShaderVariants
+{
+private:
+    std::string path;
+    // Nodes of a map do not move, so references to variants stay valid
+    std::map<std::string, ComputeShader> variants;
+public:
+    ComputeShaderVariants(const std::string& path)
+        : path(path) {}
 
-        // Create the Shader
-        ID = glCreateProgram();
-        glAttachShader(ID, sCompute);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    ComputeShader& get(const std::string& defines)
+    {
+        auto found = variants.find(defines);
+        if (found != variants.end())
+            return found->second;
 
-        // Delete the Shaders
-        glDeleteShader(sCompute);
+        ComputeShader& shader = variants[defines];
+        shader.compileFromPath(path.c_str(), defines);
+        return shader;
     }
 
-    void addStorageBuffer(const char* name, int binding, unsigned int ssbo, unsigned int bufferIndex = 1)
+    // Adds a variant without compiling it, for compiling somewhere else such as a
+    // ShaderCompiler. Returns nullptr if the variant already exists.
+    ComputeShader* add(const std::string& defines)
     {
-        int index = glGetProgramResourceIndex(ID, GL_SHADER_STORAGE_BUFFER, "bufferData");
-        glShaderStorageBlockBinding(ID, index, binding);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferIndex, ssbo);
+        if (variants.count(defines))
+            return nullptr;
+        return &variants[defines];
+    }
+
+    const std::string& getPath() const { return path; }
+    size_t size() const { return variants.size(); }
+
+    std::map<std::string, ComputeShader>::iterator begin() { return variants.begin(); }
+    std::map<std::string, ComputeShader>::iterator end() { return variants.end(); }
+
+    void clear()
+    {
+        for (auto& variant : variants)
+            glDeleteProgram(variant.second.ID);
+        variants.clear();
     }
 };
 
+// Compiles the shader's files again and swaps the new program in, deleting the old one.
+// If it fails to compile the old program is kept.
+template <typename T>
+bool reloadShader(T& shader)
+{
+    T replacement = shader;
+    if (!replacement.compileAgain())
+        return false;
+
+    glDeleteProgram(shader.ID);
+    shader = replacement;
+    return true;
+}
+
 #endif
\ No newline at end of file
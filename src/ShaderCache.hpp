@@ -0,0 +1,139 @@
+#ifndef SHADER_CACHE_HPP
+#define SHADER_CACHE_HPP
+
+#include <GLAD/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Hash.hpp"
+
+// Linked program binaries saved with glGetProgramBinary, so a later run can load them
+// with glProgramBinary instead of compiling the GLSL again. Files are named by a hash
+// of the program's sources and the driver, and a binary the driver no longer accepts
+// is compiled again and replaced.
+class ShaderCache
+{
+public:
+    static inline std::string directory = "shaderCache";
+    // Programs loaded from and compiled into the cache since startup, for the startup report
+    static inline std::atomic<unsigned int> hits { 0 };
+    static inline std::atomic<unsigned int> misses { 0 };
+
+    static bool isSupported()
+    {
+        return GLAD_GL_ARB_get_program_binary;
+    }
+
+    // Empty when binaries cannot be cached, so load always misses and store does nothing
+    static std::string getKey(std::initializer_list<const std::string*> sources)
+    {
+        if (!isSupported())
+            return "";
+
+        uint64_t hash = HASH_OFFSET_BASIS;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const char* driver = (const char*)glGetString(name);
+            hash = hashBytes(hash, driver, driver ? std::char_traits<char>::length(driver) : 0);
+        }
+
+        // Each source is followed by a separator, so moving text between stages changes the key
+        for (const std::string* source : sources)
+        {
+            if (source)
+                hash = hashBytes(hash, source->data(), source->size());
+            hash = hashBytes(hash, "\0", 1);
+        }
+
+        char key[17];
+        std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+        return key;
+    }
+
+    // Creates a program from the cached binary, or returns 0 when there is none or the driver rejects it
+    static unsigned int load(const std::string& key)
+    {
+        if (key.empty())
+        {
+            misses++;
+            return 0;
+        }
+
+        std::ifstream file(getPath(key), std::ios::binary);
+        GLenum format;
+        if (!file || !file.read((char*)&format, sizeof(format)))
+        {
+            misses++;
+            return 0;
+        }
+
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+
+        int linked;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            misses++;
+            return 0;
+        }
+
+        hits++;
+        return program;
+    }
+
+    // Call before linking a program that is going to be stored
+    static void prepare(unsigned int program, const std::string& key)
+    {
+        if (!key.empty())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    static void store(unsigned int program, const std::string& key)
+    {
+        if (key.empty())
+            return;
+
+        int linked, length;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0)
+            return;
+
+        GLenum format;
+        std::vector<char> binary(length);
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+        // Written under a temporary name so a run that stops part way leaves no truncated binary
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::string path = getPath(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file)
+                return;
+            file.write((const char*)&format, sizeof(format));
+            file.write(binary.data(), binary.size());
+        }
+        std::filesystem::rename(temporary, path, error);
+    }
+private:
+    static std::string getPath(const std::string& key)
+    {
+        return directory + "/" + key + ".bin";
+    }
+};
+
+#endif
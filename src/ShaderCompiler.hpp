@@ -0,0 +1,120 @@
+#ifndef SHADER_COMPILER_HPP
+#define SHADER_COMPILER_HPP
+
+#include <GLAD/glad.h>
+#include <SDL2/SDL.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Compiles shaders on a thread with its own OpenGL context, shared with the main one,
+// so the main thread can carry on setting up while the driver compiles. Programs made
+// by a job can be used on the main context once wait has returned.
+class ShaderCompiler
+{
+public:
+    typedef std::function<void()> Job;
+private:
+    SDL_Window* window;
+    SDL_GLContext context = NULL;
+    std::thread worker;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::deque<Job> jobs;
+    unsigned int pending = 0;
+    bool stopping = false;
+public:
+    // Call with mainContext current on this thread, which it still is afterwards. When a
+    // shared context cannot be created, jobs run straight away on the calling thread.
+    ShaderCompiler(SDL_Window* window, SDL_GLContext mainContext)
+        : window(window)
+    {
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        context = SDL_GL_CreateContext(window);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+        // Creating a context makes it current
+        SDL_GL_MakeCurrent(window, mainContext);
+
+        if (context)
+            worker = std::thread(&ShaderCompiler::workerLoop, this);
+    }
+
+    // Must be destroyed before the window and main context
+    ~ShaderCompiler()
+    {
+        if (!context)
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+
+        SDL_GL_DeleteContext(context);
+    }
+
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    bool isAsync() const { return context != NULL; }
+
+    void submit(Job job)
+    {
+        if (!context)
+        {
+            job();
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every job submitted so far has finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return pending == 0; });
+    }
+private:
+    void workerLoop()
+    {
+        SDL_GL_MakeCurrent(window, context);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return !jobs.empty() || stopping; });
+            if (jobs.empty())
+                break;
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+
+            lock.unlock();
+            job();
+            // Another context only sees the programs once the commands making them have completed
+            glFinish();
+            lock.lock();
+
+            if (--pending == 0)
+                done.notify_all();
+        }
+
+        SDL_GL_MakeCurrent(window, NULL);
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SHADER_WATCHER_HPP
+#define SHADER_WATCHER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files in a directory that have been written since the last poll, for
+// reloading shaders while the simulation runs. Uses inotify on Linux, and elsewhere
+// compares modification times a few times a second.
+class ShaderWatcher
+{
+public:
+    static constexpr double SCAN_INTERVAL = 0.25;
+private:
+    std::filesystem::path directory;
+
+#ifdef __linux__
+    int inotify = -1;
+#endif
+
+    std::map<std::string, std::filesystem::file_time_type> writeTimes;
+    std::chrono::steady_clock::time_point lastScan;
+public:
+    explicit ShaderWatcher(const std::string& directory)
+        : directory(directory)
+    {
+#ifdef __linux__
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // Editors that save by renaming a new file over the old one only show up as moves.
+        // Creation is not watched, as a new file is still empty until it is closed.
+        if (inotify >= 0 && inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            close(inotify);
+            inotify = -1;
+        }
+        if (inotify >= 0)
+            return;
+#endif
+        scan(nullptr);
+        lastScan = std::chrono::steady_clock::now();
+    }
+
+    ~ShaderWatcher()
+    {
+#ifdef __linux__
+        if (inotify >= 0)
+            close(inotify);
+#endif
+    }
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Paths of the files changed since the last call, normalised like Shader::normalisePath.
+    // Does not block.
+    std::vector<std::string> poll()
+    {
+        std::vector<std::string> changed;
+
+#ifdef __linux__
+        if (inotify >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    const inotify_event* event = (const inotify_event*)(buffer + offset);
+                    if (event->len > 0)
+                        addChanged(changed, (directory / event->name).lexically_normal().generic_string());
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+            return changed;
+        }
+#endif
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastScan).count() < SCAN_INTERVAL)
+            return changed;
+
+        lastScan = now;
+        scan(&changed);
+        return changed;
+    }
+private:
+    static void addChanged(std::vector<std::string>& changed, const std::string& path)
+    {
+        if (std::find(changed.begin(), changed.end(), path) == changed.end())
+            changed.push_back(path);
+    }
+
+    // Records every file's modification time, adding those that differ from last time to changed
+    void scan(std::vector<std::string>* changed)
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+        {
+            std::filesystem::file_time_type time = entry.last_write_time(error);
+            if (error)
+                continue;
+
+            std::string path = entry.path().lexically_normal().generic_string();
+            auto previous = writeTimes.find(path);
+            if (changed && (previous == writeTimes.end() || previous->second != time))
+                addChanged(*changed, path);
+            writeTimes[path] = time;
+        }
+    }
+};
+
+#endif
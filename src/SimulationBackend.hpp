@@ -0,0 +1,115 @@
+#ifndef SIMULATION_BACKEND_HPP
+#define SIMULATION_BACKEND_HPP
+
+#include <GLM/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "AgentSpawner.hpp"
+#include "AgentStore.hpp"
+#include "ThreadPool.hpp"
+
+// Largest diffuse radius the GPU passes can load into shared memory, see boxSum.glsl
+const int MAX_DIFFUSE_RADIUS = 16;
+
+// Agents are sorted by which square of this many pixels they are in, see mortonKey
+const unsigned int AGENT_SORT_TILE = 16;
+
+// Interleaves the bits of a tile's coordinates, so tiles close in 2D get close keys.
+// Mirrored by agentSortCompute.glsl.
+inline uint32_t mortonKey(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint32_t v)
+    {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// Agent storage to reserve to hold count agents, when it holds capacity. Growing at
+// least doubles it, so adding agents a few at a time copies each one O(1) times.
+inline size_t getGrownAgentCapacity(size_t capacity, size_t count)
+{
+    return count > capacity ? std::max(count, capacity * 2) : capacity;
+}
+
+enum class depositMode
+{
+    // Each agent sets its pixel to the deposit amount, so agents sharing a pixel count once
+    OVERWRITE,
+    // Every agent adds the deposit amount, so the trail shows density
+    ACCUMULATE
+};
+
+struct SimulationSettings
+{
+    float decayAmount;
+    float diffuseSpeed;
+    // Half width of the box blur, averaged over the pixels inside the trail map
+    int diffuseRadius;
+    float movementDistance;
+
+    float sensorDistance;
+    float sensorAngle;
+    float rotationAngle;
+
+    depositMode deposit;
+    float depositAmount;
+
+    // Random numbers are keyed by (seed, agent, step), so a run replays exactly from the same state
+    uint32_t seed;
+
+    // Agents are reordered by tile every sortInterval steps, so agents that read and
+    // write the same part of the trail map are next to each other in memory. 0 never sorts.
+    int sortInterval;
+};
+
+class Profiler;
+
+class SimulationBackend
+{
+protected:
+    Profiler* profiler = nullptr;
+public:
+    virtual ~SimulationBackend() {}
+
+    virtual const char* getName() const = 0;
+
+    // Reallocates the trail map at a new size and removes every agent, so reset has
+    // to be called with agents spawned for the new size before stepping again
+    virtual void resize(unsigned int width, unsigned int height) = 0;
+
+    // Replaces every agent and clears the trail map
+    virtual void reset(const AgentStore& agents) = 0;
+
+    // Same as reset with count agents from spawnAgents, but spawns them straight into
+    // wherever the backend keeps its agents instead of copying them from a store
+    virtual void spawn(ThreadPool& pool, const SpawnSettings& settings, size_t count) = 0;
+
+    // Adds agents from spawnAgents after the existing ones, or removes agents spread over
+    // the population, until there are count. The remaining agents and the trail map are
+    // untouched, so it takes time in proportion to the change rather than the agent count,
+    // with storage grown by getGrownAgentCapacity.
+    virtual void setAgentCount(ThreadPool& pool, const SpawnSettings& settings, size_t count) = 0;
+
+    // Runs the agent and diffuse/decay passes once
+    virtual void step(const SimulationSettings& settings, float deltaTime) = 0;
+
+    // Blocks until all submitted steps have completed, so they can be timed
+    virtual void finish() {}
+
+    // Single channel texture holding the current trail strength, coloured when drawn
+    virtual unsigned int getTexture() = 0;
+
+    // Passes are timed into the profiler while one is set, which has to outlive the backend
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SIMULATION_CLOCK_HPP
+#define SIMULATION_CLOCK_HPP
+
+// Fixed timestep accumulator. Frame time is fed in and the number of whole
+// steps to run is handed back, so the physics is the same whatever the frame rate.
+class SimulationClock
+{
+public:
+    float timestep;
+    int maxSubsteps;
+private:
+    double accumulator = 0.0;
+
+    // Rolling one second window used for the rates shown in the UI
+    double windowTime = 0.0;
+    double windowStepTime = 0.0;
+    int windowSteps = 0;
+
+    double stepsPerSecond = 0.0;
+    double simulationStepsPerSecond = 0.0;
+public:
+    SimulationClock(float timestep = 1.0f / 60.0f, int maxSubsteps = 8)
+        : timestep(timestep), maxSubsteps(maxSubsteps) {}
+
+    // Returns how many steps of `timestep` should run for a frame that took frameTime seconds
+    int advance(double frameTime)
+    {
+        accumulator += frameTime;
+
+        int steps = (int)(accumulator / timestep);
+        accumulator -= steps * (double)timestep;
+
+        // Drop what cannot be caught up rather than falling further behind every frame
+        if (steps > maxSubsteps)
+        {
+            steps = maxSubsteps;
+            accumulator = 0.0;
+        }
+
+        return steps;
+    }
+
+    // Discards accumulated time, e.g. while paused
+    void hold() { accumulator = 0.0; }
+
+    // Records a frame that ran `steps` steps which took stepTime seconds of simulation work
+    void record(double frameTime, int steps, double stepTime)
+    {
+        windowTime += frameTime;
+        windowStepTime += stepTime;
+        windowSteps += steps;
+
+        if (windowTime >= 1.0)
+        {
+            stepsPerSecond = windowSteps / windowTime;
+            simulationStepsPerSecond = windowStepTime > 0.0 ? windowSteps / windowStepTime : 0.0;
+
+            windowTime = 0.0;
+            windowStepTime = 0.0;
+            windowSteps = 0;
+        }
+    }
+
+    // Steps completed per second of wall time
+    double getStepsPerSecond() const { return stepsPerSecond; }
+
+    // Steps per second counting only the time spent stepping, without vsync or UI
+    double getSimulationStepsPerSecond() const { return simulationStepsPerSecond; }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <GLM/glm.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes a trail map as a binary PPM in the given colour, flipped so row 0 ends up at the bottom like on screen
+inline bool writeSnapshot(const std::string& path, unsigned int width, unsigned int height, const std::vector<float>& trail, const glm::vec4& colour)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR::SNAPSHOT: Unable to open " << path << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    std::vector<unsigned char> row(width * 3);
+    for (int y = (int)height - 1; y >= 0; y--)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            glm::vec3 pixel = trail[(size_t)y * width + x] * glm::vec3(colour);
+            row[x * 3 + 0] = (unsigned char)(std::min(std::max(pixel.r, 0.0f), 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 1] = (unsigned char)(std::min(std::max(pixel.g, 0.0f), 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 2] = (unsigned char)(std::min(std::max(pixel.b, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+
+    return (bool)file;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Called with [begin, end) and the index of the thread running the chunk
+    typedef std::function<void(size_t, size_t, unsigned int)> Job;
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Job* currentJob = nullptr;
+    size_t jobCount = 0;
+    size_t jobGrain = 1;
+    std::atomic<size_t> nextIndex { 0 };
+
+    unsigned int activeWorkers = 0;
+    unsigned int generation = 0;
+    bool stopping = false;
+public:
+    ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        // The calling thread always takes part, so it counts as one of the threads
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int getThreadCount() const { return workers.size() + 1; }
+
+    // Splits [0, count) into chunks of at most grain and blocks until every chunk has run
+    void parallelFor(size_t count, size_t grain, const Job& job)
+    {
+        if (count == 0)
+            return;
+
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || count <= grain)
+        {
+            for (size_t begin = 0; begin < count; begin += grain)
+                job(begin, std::min(begin + grain, count), 0);
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            currentJob = &job;
+            jobCount = count;
+            jobGrain = grain;
+            nextIndex = 0;
+            activeWorkers = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunks(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return activeWorkers == 0; });
+        currentJob = nullptr;
+    }
+private:
+    void workerLoop(unsigned int index)
+    {
+        unsigned int seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+                if (stopping)
+                    return;
+                seenGeneration = generation;
+            }
+
+            runChunks(index);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--activeWorkers == 0)
+                done.notify_one();
+        }
+    }
+
+    void runChunks(unsigned int index)
+    {
+        while (true)
+        {
+            size_t begin = nextIndex.fetch_add(jobGrain);
+            if (begin >= jobCount)
+                break;
+
+            (*currentJob)(begin, std::min(begin + jobGrain, jobCount), index);
+        }
+    }
+};
+
+#endif